@@ -65,7 +65,8 @@ void GenerateTradeData()
 	{
 		for (int j = 0; j < 10; j++)
 		{
-			string tradeid = GenerateId();
+			char tradeid[IdWidth];
+			int idlength = WriteId(IdGenerator::NextId(), tradeid);
 			string side = "SELL";
 			string price = PricetoFraction(100.0);
 			if (tradecount % 2)
@@ -78,7 +79,8 @@ void GenerateTradeData()
 			if (tradecount % 3 == 1) book = "TRSY1";
 			else if (tradecount % 3 == 2) book = "TRSY2";
 			long quant = ((tradecount % 5) + 1) * 1000000;
-			file << cusips[i] << "," << tradeid << "," << price << "," << book << "," << quant << "," << side << endl;
+			file << cusips[i] << ",";
+			file.write(tradeid, idlength) << "," << price << "," << book << "," << quant << "," << side << endl;
 			tradecount++;
 		}
 	}
@@ -147,7 +149,8 @@ void GenerateInquiries()
 	{
 		for (int j = 0; j < 10; j++)
 		{
-			string tradeid = GenerateId();
+			char inquiryid[IdWidth];
+			int idlength = WriteId(IdGenerator::NextId(), inquiryid);
 			string side = "SELL";
 			string price = PricetoFraction(100.0);
 			if (tradecount % 2)
@@ -157,7 +160,7 @@ void GenerateInquiries()
 			}
 
 			long quant = ((tradecount % 5) + 1) * 1000000;
-			file << tradeid << "," << cusips[i] << "," << side  << "," << quant << "," << price <<",RECEIVED"<< endl;
+			file.write(inquiryid, idlength) << "," << cusips[i] << "," << side  << "," << quant << "," << price <<",RECEIVED"<< endl;
 			tradecount++;
 		}
 	}
@@ -9,6 +9,7 @@
 
 #include "soa.hpp"
 #include "pricingservice.hpp"
+#include "asyncwriter.hpp"
 #include <iomanip>
 
 /*
@@ -43,7 +44,12 @@ public:
 		PricingListener = new GUIPricingListener<T>(this);
 		time = 0;
 	}
-	~GUIService() = default;
+	~GUIService()
+	{
+		delete connector;
+	}
+	GUIService(const GUIService&) = delete;
+	GUIService& operator=(const GUIService&) = delete;
 
 	// Get data on our service given a key
 	Price<T>& GetData(string key)
@@ -99,6 +105,13 @@ public:
 	{
 		time = t;
 	}
+
+	// Write gui.txt through an asynchronous writer, on io_uring if uring is set and it is available
+	// Returns false if the file cannot be opened
+	bool EnableAsyncWriter(bool uring = true)
+	{
+		return connector->EnableAsyncWriter(uring);
+	}
 };
 
 
@@ -110,13 +123,37 @@ class GUIConnector : public Connector<Price<T>>
 {
 private:
 	GUIService<T>* service;
+	//Asynchronous writer of gui.txt, nullptr to open the file for each update
+	AsyncFileWriter* asyncwriter;
+	//Buffer of the file stream opened for each update, so opening it does not allocate one
+	vector<char> filebuffer;
 public:
 	//Ctor and Dtor
 	GUIConnector(GUIService<T>* s)
 	{
 		service = s;
+		asyncwriter = nullptr;
+		filebuffer.resize(BUFSIZ);
+	}
+	~GUIConnector()
+	{
+		delete asyncwriter;
+	}
+
+	// Write gui.txt through an asynchronous writer
+	bool EnableAsyncWriter(bool uring = true)
+	{
+		delete asyncwriter;
+		asyncwriter = new AsyncFileWriter("gui.txt", uring);
+		if (!asyncwriter->IsOpen())
+		{
+			delete asyncwriter;
+			asyncwriter = nullptr;
+			return false;
+		}
+		asyncwriter->GetStream() << std::fixed << std::setprecision(6);
+		return true;
 	}
-	~GUIConnector() = default;
 	//Publish Data
 	void Publish(Price<T>& data)
 	{
@@ -124,10 +161,15 @@ public:
 		//cout << timenow << endl;
 		timenow += rand() % 10 + 1;//Add a random time
 		service->SetTime(timenow);
-		if (timenow-(timenow/300)*300 < 10)
+		if (timenow-(timenow/300)*300 < 10 && asyncwriter != nullptr)
+		{
+			asyncwriter->GetStream() << timenow << "," << data.GetProduct().GetProductId() << "," << data.GetMid() << "," << data.GetBidOfferSpread() << endl;
+		}
+		else if (timenow-(timenow/300)*300 < 10)
 		{
 			//service->SetTime(timenow);
 			ofstream file;
+			file.rdbuf()->pubsetbuf(filebuffer.data(), filebuffer.size());
 			file.open("gui.txt", ios::app);
 			file << std::fixed << std::setprecision(6);
 			file << timenow << "," << data.GetProduct().GetProductId() << "," << data.GetMid() << "," << data.GetBidOfferSpread() << endl;
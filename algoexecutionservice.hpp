@@ -10,9 +10,14 @@
 
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "columnarstore.hpp"
+#include "serializer.hpp"
 
+enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
 template<typename T>
 class ExecutionOrder
@@ -20,19 +25,36 @@ class ExecutionOrder
 private:
 	T product;
 	PricingSide side;
-	string orderId;
+	unsigned long long orderId;
 	double price;
 	long quantity;
+	OrderType orderType;
+	unsigned long long parentOrderId;
+	bool isChildOrder;
 public:
 	//Ctor and Dtor
-	ExecutionOrder() {}
-	ExecutionOrder(const T& p, PricingSide s, string Id, double pr, long q)
+	ExecutionOrder() : product(), side(BID), orderId(0), price(0), quantity(0), orderType(MARKET), parentOrderId(0), isChildOrder(false) {}
+	ExecutionOrder(const T& p, PricingSide s, unsigned long long Id, double pr, long q)
 	{
 		product = p;
 		side = s;
 		orderId = Id;
 		price = pr;
 		quantity = q;
+		orderType = MARKET;
+		parentOrderId = 0;
+		isChildOrder = false;
+	}
+	ExecutionOrder(const T& p, PricingSide s, unsigned long long Id, OrderType t, double pr, long q, unsigned long long parentId, bool child)
+	{
+		product = p;
+		side = s;
+		orderId = Id;
+		orderType = t;
+		price = pr;
+		quantity = q;
+		parentOrderId = parentId;
+		isChildOrder = child;
 	}
 	~ExecutionOrder() = default;
 
@@ -48,8 +70,14 @@ public:
 		return side;
 	}
 
+	// Get the order ID as text
+	string GetOrderId() const
+	{
+		return IdToString(orderId);
+	}
+
 	// Get the order ID
-	const string& GetOrderId() const
+	unsigned long long GetOrderNumber() const
 	{
 		return orderId;
 	}
@@ -66,45 +94,107 @@ public:
 		return quantity;
 	}
 
+	// Get the order type on this order
+	OrderType GetOrderType() const
+	{
+		return orderType;
+	}
+
+	// Get the parent order ID (0 if none)
+	unsigned long long GetParentOrderNumber() const
+	{
+		return parentOrderId;
+	}
+
+	// Is child order?
+	bool IsChildOrder() const
+	{
+		return isChildOrder;
+	}
+
 	//Output function
 	ostream& Output(ostream& file)
 	{
-		file << GetProduct().GetProductId() << "," << GetOrderId() << ",";
-		if (GetPricingSide() == BID)
-		{
-			file << "BID,";
-		}
-		else if (GetPricingSide() == OFFER)
-		{
-			file << "OFFER,";
-		}
-		file << GetPrice() << "," << GetQuantity() << endl;
-		return file;
+		return Serialize(file, *this);
 	}
 };
 
 
 
+/*
+* CSV line of an execution order: the product, the order id, the side, the price and the quantity
+*/
 template<typename T>
-class AlgoExecution
+struct SerializerTraits<ExecutionOrder<T>>
 {
-private:
-	ExecutionOrder<T>* executionorder;
+	static const bool Defined = true;
+	static size_t MaxSize(const ExecutionOrder<T>& data)
+	{
+		return data.GetProduct().GetProductId().size() + IdWidth + 6 + FixedTextSize + LongTextSize + 4;
+	}
+	static size_t Write(const ExecutionOrder<T>& data, char* buf)
+	{
+		char* p = buf + WriteText(buf, data.GetProduct().GetProductId());
+		*p++ = ',';
+		p += WriteId(data.GetOrderNumber(), p);
+		*p++ = ',';
+		if (data.GetPricingSide() == BID) p += WriteText(p, "BID,", 4);
+		else if (data.GetPricingSide() == OFFER) p += WriteText(p, "OFFER,", 6);
+		p += WriteFixed(p, data.GetPrice());
+		*p++ = ',';
+		p += WriteLong(p, data.GetQuantity());
+		*p++ = '\n';
+		return p - buf;
+	}
+};
 
+/*
+* Columns of an execution order
+*/
+template<typename T>
+struct ColumnarTraits<ExecutionOrder<T>>
+{
+	static const int Columns = 7;
+	static const ColumnSpec* GetColumns()
+	{
+		static const ColumnSpec columns[] = { { "timestamp", COLUMN_INT64 }, { "product", COLUMN_STRING }, { "order", COLUMN_INT64 },
+			{ "side", COLUMN_INT64 }, { "type", COLUMN_INT64 }, { "price", COLUMN_FLOAT64 }, { "quantity", COLUMN_INT64 } };
+		return columns;
+	}
+	template<typename W>
+	static void Write(W& writer, long long timestamp, const ExecutionOrder<T>& data)
+	{
+		ColumnCell row[Columns];
+		row[0].i = timestamp;
+		row[1].i = writer.Code(data.GetProduct().GetProductId());
+		row[2].i = (long long)data.GetOrderNumber();
+		row[3].i = data.GetPricingSide();
+		row[4].i = data.GetOrderType();
+		row[5].d = data.GetPrice();
+		row[6].i = data.GetQuantity();
+		writer.AppendRow(row);
+	}
+};
 
+template<typename T>
+class AlgoExecution
+{
+private:
+	//The order is held by value so that it is reused with the AlgoExecution
+	ExecutionOrder<T> executionorder;
 
 public:
 	//Ctor and Dtor
 	AlgoExecution() {}
-	AlgoExecution(const T& p, PricingSide s, string Id, double pr, long q)
+	AlgoExecution(const T& p, PricingSide s, unsigned long long Id, double pr, long q) :
+		executionorder(p, s, Id, pr, q)
 	{
-		executionorder = new ExecutionOrder<T>(p, s, Id, pr, q);
 	}
 
 	//Getter
-	ExecutionOrder<T>* GetExecutionOrder() const
+	ExecutionOrder<T>* GetExecutionOrder()
 	{
-		return executionorder;
+		return &executionorder;
 	}
 };
 
@@ -116,7 +206,11 @@ template<typename T>
 class AlgoExecutionMarketDataListener;
 
 /*
-* Service for algo-execution
+* Service for algo-execution.
+* Aggresses the best bid and offer alternately, per product, whenever the spread is at its tightest.
+* With a sweep quantity set, it targets that quantity through the depth of the book instead,
+* priced at the last level reached.
+* The strategy state of the products is held in a structure of arrays indexed by product slot.
 */
 template<typename T>
 class AlgoExecutionService : public Service<string, AlgoExecution<T>>
@@ -125,13 +219,27 @@ private:
 	map<string, AlgoExecution<T>> algoexecutionmap;
 	vector<ServiceListener<AlgoExecution<T>>*> listeners;
 	AlgoExecutionMarketDataListener<T>* MarketDataListener;
-	bool BidOrOffer;
+
+	//Strategy state per product slot: last side aggressed, last spread seen,
+	//book updates left to skip, the number and quantity of executions sent and their last average price
+	unordered_map<string, size_t> slots;
+	vector<PricingSide> lastsides;
+	vector<double> lastspreads;
+	vector<long> cooldowns;
+	vector<long> executioncounts;
+	vector<long> executedquantities;
+	vector<double> averageprices;
+	long cooldown;
+	double tightestspread;
+	long sweepquantity;
 
 public:
 	//Ctor and Dtor
 	AlgoExecutionService()
 	{
-		BidOrOffer = 1;
+		cooldown = 0;
+		tightestspread = 1.0 / 128.0;
+		sweepquantity = 0;
 		algoexecutionmap = map<string, AlgoExecution<T>>();
 		listeners = vector<ServiceListener<AlgoExecution<T>>*>();
 		MarketDataListener = new AlgoExecutionMarketDataListener<T>(this);
@@ -174,39 +282,104 @@ public:
 		return MarketDataListener;
 	}
 
+	// Set the number of book updates a product skips after each execution
+	void SetCooldown(long updates)
+	{
+		cooldown = max(0L, updates);
+	}
+
+	// Set the quantity to sweep through the book on each execution, 0 to take the top level only
+	void SetSweepQuantity(long quantity)
+	{
+		sweepquantity = max(0L, quantity);
+	}
+
+	// Get the average price of the last execution on a product
+	double GetAveragePrice(const string& productId) const
+	{
+		auto it = slots.find(productId);
+		return it == slots.end() ? 0.0 : averageprices[it->second];
+	}
+
+	// Get the last spread seen on a product
+	double GetLastSpread(const string& productId) const
+	{
+		auto it = slots.find(productId);
+		return it == slots.end() ? 0.0 : lastspreads[it->second];
+	}
+
+	// Get the number of executions sent on a product
+	long GetExecutionCount(const string& productId) const
+	{
+		auto it = slots.find(productId);
+		return it == slots.end() ? 0 : executioncounts[it->second];
+	}
+
+	// Get the quantity executed on a product
+	long GetExecutedQuantity(const string& productId) const
+	{
+		auto it = slots.find(productId);
+		return it == slots.end() ? 0 : executedquantities[it->second];
+	}
+
 	//Execute Order
 	void ExecuteOrder(OrderBook<T>& odb)
 	{
-		T product = odb.GetProduct();
-		string productid = product.GetProductId();
-		string orderid = GenerateId();
-		PricingSide side;
-		double price;
-		long quantity;
-
-		BidOffer bidoffer = odb.GetBidOffer();
-		Order bidorder = bidoffer.GetBidOrder();
-		Order offerorder = bidoffer.GetOfferOrder();
-		if (offerorder.GetPrice() - bidorder.GetPrice() <= 1.0 / 128.0)
+		if (!odb.HasBidOffer()) return;
+		const T& product = odb.GetProduct();
+		size_t slot = GetSlot(product.GetProductId());
+
+		const Order& bidorder = odb.GetBestBid();
+		const Order& offerorder = odb.GetBestOffer();
+		double spread = offerorder.GetPrice() - bidorder.GetPrice();
+		lastspreads[slot] = spread;
+		if (cooldowns[slot] > 0)
+		{
+			cooldowns[slot]--;
+			return;
+		}
+		if (spread > tightestspread) return;
+
+		//Alternate the side aggressed on this product
+		PricingSide side = lastsides[slot] == BID ? OFFER : BID;
+		const Order& order = side == BID ? bidorder : offerorder;
+		double price = order.GetPrice();
+		long quantity = order.GetQuantity();
+		double average = price;
+		if (sweepquantity > 0)
 		{
-			if (BidOrOffer == 1)
-			{
-				BidOrOffer = 0;
-				price = bidorder.GetPrice();
-				quantity = bidorder.GetQuantity();
-				side = BID;
-			}
-			else
-			{
-				BidOrOffer = 1;
-				price = offerorder.GetPrice();
-				quantity = offerorder.GetQuantity();
-				side = OFFER;
-			}
-			AlgoExecution<T> algoEx(product, side, orderid, price, quantity);
-			//cout << orderid << "," << side << "," << price << "," << quantity << endl;
-			OnMessage(algoEx);
+			DepthSweep sweep = odb.SweepDepth(side, sweepquantity);
+			if (sweep.quantity <= 0) return;
+			price = sweep.limitPrice;
+			quantity = sweep.quantity;
+			average = sweep.averagePrice;
 		}
+		lastsides[slot] = side;
+		cooldowns[slot] = cooldown;
+		executioncounts[slot]++;
+		executedquantities[slot] += quantity;
+		averageprices[slot] = average;
+
+		AlgoExecution<T> algoEx(product, side, IdGenerator::NextId(), price, quantity);
+		OnMessage(algoEx);
+	}
+
+private:
+	// Get the slot of a product, adding it if it is new
+	size_t GetSlot(const string& productId)
+	{
+		auto it = slots.find(productId);
+		if (it != slots.end()) return it->second;
+		size_t slot = lastsides.size();
+		slots[productId] = slot;
+		//The first execution of a product is on the bid
+		lastsides.push_back(OFFER);
+		lastspreads.push_back(0.0);
+		cooldowns.push_back(0);
+		executioncounts.push_back(0);
+		executedquantities.push_back(0);
+		averageprices.push_back(0.0);
+		return slot;
 	}
 };
 
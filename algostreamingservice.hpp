@@ -12,6 +12,8 @@
 #include "soa.hpp"
 #include "pricingservice.hpp"
 #include "marketdataservice.hpp"
+#include "columnarstore.hpp"
+#include "serializer.hpp"
 
 /*
 * 
@@ -62,31 +64,85 @@ public:
 	//Output function
 	ostream& Output(ostream& file)
 	{
-		file << GetProduct().GetProductId() << "," << GetBidPrice() << "," << GetOfferPrice() << "," << GetVisibleQuantity() << "," << GetHiddenQuantity() << endl;
-		return file;
+		return Serialize(file, *this);
 	}
 };
 
 
+/*
+* CSV line of a price stream: the product, the bid and offer prices and the visible and hidden quantities
+*/
+template<typename T>
+struct SerializerTraits<PriceStream<T>>
+{
+	static const bool Defined = true;
+	static size_t MaxSize(const PriceStream<T>& data)
+	{
+		return data.GetProduct().GetProductId().size() + 2 * FixedTextSize + 2 * LongTextSize + 5;
+	}
+	static size_t Write(const PriceStream<T>& data, char* buf)
+	{
+		char* p = buf + WriteText(buf, data.GetProduct().GetProductId());
+		*p++ = ',';
+		p += WriteFixed(p, data.GetBidPrice());
+		*p++ = ',';
+		p += WriteFixed(p, data.GetOfferPrice());
+		*p++ = ',';
+		p += WriteLong(p, data.GetVisibleQuantity());
+		*p++ = ',';
+		p += WriteLong(p, data.GetHiddenQuantity());
+		*p++ = '\n';
+		return p - buf;
+	}
+};
+
+/*
+* Columns of a price stream
+*/
+template<typename T>
+struct ColumnarTraits<PriceStream<T>>
+{
+	static const int Columns = 6;
+	static const ColumnSpec* GetColumns()
+	{
+		static const ColumnSpec columns[] = { { "timestamp", COLUMN_INT64 }, { "product", COLUMN_STRING }, { "bid", COLUMN_FLOAT64 },
+			{ "offer", COLUMN_FLOAT64 }, { "visible", COLUMN_INT64 }, { "hidden", COLUMN_INT64 } };
+		return columns;
+	}
+	template<typename W>
+	static void Write(W& writer, long long timestamp, const PriceStream<T>& data)
+	{
+		ColumnCell row[Columns];
+		row[0].i = timestamp;
+		row[1].i = writer.Code(data.GetProduct().GetProductId());
+		row[2].d = data.GetBidPrice();
+		row[3].d = data.GetOfferPrice();
+		row[4].i = data.GetVisibleQuantity();
+		row[5].i = data.GetHiddenQuantity();
+		writer.AppendRow(row);
+	}
+};
+
 /*
 */
 template<typename T>
 class AlgoStream
 {
 private:
-	PriceStream<T>* pricestream;
+	//The stream is held by value so that it is reused with the AlgoStream
+	PriceStream<T> pricestream;
 public:
 	//Ctor and Dtor
 	AlgoStream() {}
-	AlgoStream(T pdt, double bidp, double offerp, long visible_quantity, long hidden_quantity)
+	AlgoStream(T pdt, double bidp, double offerp, long visible_quantity, long hidden_quantity) :
+		pricestream(pdt, bidp, offerp, visible_quantity, hidden_quantity)
 	{
-		pricestream = new PriceStream<T>(pdt, bidp, offerp, visible_quantity, hidden_quantity);
 	}
 	~AlgoStream() = default;
 	//Get the order
 	PriceStream<T>* GetPriceStream()
 	{
-		return pricestream;
+		return &pricestream;
 	}
 };
 
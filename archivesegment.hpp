@@ -0,0 +1,174 @@
+/*
+* archivesegment.hpp
+* Append-only archive of compact records
+* Author: Tengxiao Fan
+*/
+
+#ifndef ARCHIVESEGMENT_HPP
+#define ARCHIVESEGMENT_HPP
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+// Copy a string into a fixed-width field, zero padded: a longer string is rejected (invalid_argument)
+void PackString(char* field, size_t size, const string& s)
+{
+	if (s.size() > size) throw invalid_argument("'" + s + "' is longer than its field of " + to_string(size) + " characters");
+	memcpy(field, s.data(), s.size());
+	memset(field + s.size(), 0, size - s.size());
+}
+
+// Read a string back from a fixed-width field
+string UnpackString(const char* field, size_t size)
+{
+	size_t n = 0;
+	while (n < size && field[n] != 0) n++;
+	return string(field, n);
+}
+
+/*
+* Append-only archive of fixed-size records (R must be trivially copyable).
+* Records are appended to an in-memory segment; a full segment is sealed,
+* written to the archive file and dropped from memory, so memory stays at one segment.
+* The file is truncated when the archive is opened, an archive lives as long as its owner.
+* An archive file that cannot be opened or written throws runtime_error rather than keep
+* growing in memory; a segment that failed to be written stays and is written with the next append.
+*/
+template<typename R>
+class ArchiveSegment
+{
+private:
+	string filename;
+	size_t capacity;
+	vector<R> segment;
+	FILE* file;
+	size_t sealed;
+
+	// Write the current segment to the file, after the sealed records
+	void Seal()
+	{
+		if (segment.empty()) return;
+		fseek(file, (long)(sealed * sizeof(R)), SEEK_SET);
+		size_t n = fwrite(segment.data(), sizeof(R), segment.size(), file);
+		if (fflush(file) != 0 || n != segment.size()) throw runtime_error("cannot write the archive file " + filename);
+		sealed += segment.size();
+		segment.clear();
+	}
+
+public:
+	//Ctor and Dtor
+	ArchiveSegment(const string& name, size_t segmentsize = 4096)
+	{
+		filename = name;
+		capacity = segmentsize > 0 ? segmentsize : 1;
+		segment.reserve(capacity);
+		file = fopen(filename.c_str(), "wb+");
+		if (file == nullptr) throw runtime_error("cannot open the archive file " + filename);
+		sealed = 0;
+	}
+	~ArchiveSegment()
+	{
+		fclose(file);
+	}
+	ArchiveSegment(const ArchiveSegment&) = delete;
+	ArchiveSegment& operator=(const ArchiveSegment&) = delete;
+
+	// Append a record
+	void Append(const R& record)
+	{
+		segment.push_back(record);
+		if (segment.size() >= capacity) Seal();
+	}
+
+	// Get the number of records archived
+	size_t GetSize() const
+	{
+		return sealed + segment.size();
+	}
+
+	// Get the number of records held in memory
+	size_t GetMemorySize() const
+	{
+		return segment.size();
+	}
+
+	// Get the number of records in a segment
+	size_t GetSegmentSize() const
+	{
+		return capacity;
+	}
+
+	// Call f(record) on the records of one segment (record i is in segment i / GetSegmentSize())
+	template<typename F>
+	void ForEachInSegment(size_t s, F f)
+	{
+		if (s * capacity >= sealed)
+		{
+			for (size_t i = 0; i < segment.size(); i++) f(segment[i]);
+			return;
+		}
+		vector<R> block(capacity);
+		fseek(file, (long)(s * capacity * sizeof(R)), SEEK_SET);
+		size_t n = fread(block.data(), sizeof(R), capacity, file);
+		for (size_t i = 0; i < n; i++) f(block[i]);
+	}
+
+	// Call f(record) on every record, oldest first; f returns false to stop
+	template<typename F>
+	void ForEach(F f)
+	{
+		if (sealed > 0)
+		{
+			vector<R> block(capacity);
+			fseek(file, 0, SEEK_SET);
+			size_t left = sealed;
+			while (left > 0)
+			{
+				size_t n = fread(block.data(), sizeof(R), min(left, capacity), file);
+				if (n == 0) break;
+				for (size_t i = 0; i < n; i++)
+				{
+					if (!f(block[i])) return;
+				}
+				left -= n;
+			}
+		}
+		for (size_t i = 0; i < segment.size(); i++)
+		{
+			if (!f(segment[i])) return;
+		}
+	}
+
+	// Find the newest record matching a predicate
+	template<typename F>
+	bool Find(F match, R& result)
+	{
+		for (size_t i = segment.size(); i > 0; i--)
+		{
+			if (match(segment[i - 1]))
+			{
+				result = segment[i - 1];
+				return true;
+			}
+		}
+		bool found = false;
+		ForEach([&](const R& r)
+		{
+			if (match(r))
+			{
+				result = r;
+				found = true;
+			}
+			return true;
+		});
+		return found;
+	}
+};
+
+#endif // !ARCHIVESEGMENT_HPP
@@ -0,0 +1,476 @@
+/*
+* asyncwriter.hpp
+* Asynchronous file writer on io_uring, with a plain write fallback
+* Author: Tengxiao Fan
+*/
+
+#ifndef ASYNCWRITER_HPP
+#define ASYNCWRITER_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <streambuf>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/falloc.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define ASYNCWRITER_URING 1
+#endif
+
+using namespace std;
+
+/*
+* Append-only file writer that formats straight into its I/O buffers.
+* It is a streambuf: GetStream returns an ostream whose output lands in the current buffer,
+* and a full buffer is handed to the kernel while formatting goes on in the next one.
+* With io_uring the buffers are registered once and written with fixed-buffer writes at explicit
+* offsets, submitted in batches; without it (no header, or the kernel refuses the ring)
+* a full buffer is written with pwrite. Space is preallocated ahead of the writes with fallocate,
+* keeping the file size, and what is left is released when the writer is destroyed.
+* Flushing the stream (endl) does not write: data is on its way to the kernel once its buffer
+* is full, and all of it once Flush returns (or the writer is destroyed).
+*/
+class AsyncFileWriter : public streambuf
+{
+private:
+	struct Buffer
+	{
+		char* data;
+		size_t size;
+		size_t done;
+		off_t offset;
+		bool busy;
+	};
+
+	int fd;
+	ostream stream;
+	char* memory;
+	size_t buffersize;
+	vector<Buffer> buffers;
+	vector<int> freebuffers;
+	int current;
+	off_t offset;
+	off_t allocated;
+	bool preallocate;
+	unsigned long long bytes;
+	bool failed;
+
+	//Ring: its descriptor (-1 without io_uring), the mapped queues and the submissions not yet entered
+	int ring;
+	unsigned int batch;
+	unsigned int pending;
+	unsigned int inflight;
+	void* sqmemory;
+	size_t sqsize;
+	void* cqmemory;
+	size_t cqsize;
+#ifdef ASYNCWRITER_URING
+	io_uring_sqe* sqes;
+	size_t sqessize;
+	unsigned int* sqtail;
+	unsigned int* sqmask;
+	unsigned int* sqarray;
+	unsigned int* cqhead;
+	unsigned int* cqtail;
+	unsigned int* cqmask;
+	io_uring_cqe* cqes;
+#endif
+
+	// Write a whole range at an offset with pwrite
+	bool WriteAt(const char* p, size_t size, off_t at)
+	{
+		while (size > 0)
+		{
+			ssize_t n = pwrite(fd, p, size, at);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) return false;
+			p += n;
+			size -= n;
+			at += n;
+		}
+		return true;
+	}
+
+	// Preallocate the file past an offset, by as much as all the buffers or the bytes written so far
+	void Preallocate(off_t end)
+	{
+		if (!preallocate || end <= allocated) return;
+		off_t length = max(end - allocated, max((off_t)(buffersize * buffers.size()), (off_t)bytes));
+		if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, length) != 0)
+		{
+			preallocate = false;
+			return;
+		}
+		allocated += length;
+	}
+
+#ifdef ASYNCWRITER_URING
+	// Set up the ring and register the buffers, returns false if io_uring is unavailable
+	bool SetupRing()
+	{
+		io_uring_params params;
+		memset(&params, 0, sizeof(params));
+		ring = (int)syscall(__NR_io_uring_setup, (unsigned int)buffers.size(), &params);
+		if (ring < 0) return false;
+
+		sqsize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+		cqsize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		if (params.features & IORING_FEAT_SINGLE_MMAP) sqsize = cqsize = max(sqsize, cqsize);
+		sqmemory = mmap(nullptr, sqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+		if (sqmemory == MAP_FAILED) sqmemory = nullptr;
+		cqmemory = sqmemory;
+		if (sqmemory != nullptr && !(params.features & IORING_FEAT_SINGLE_MMAP))
+		{
+			cqmemory = mmap(nullptr, cqsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+			if (cqmemory == MAP_FAILED) cqmemory = nullptr;
+		}
+		sqessize = params.sq_entries * sizeof(io_uring_sqe);
+		void* sqememory = mmap(nullptr, sqessize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+		sqes = sqememory == MAP_FAILED ? nullptr : (io_uring_sqe*)sqememory;
+		if (sqmemory == nullptr || cqmemory == nullptr || sqes == nullptr)
+		{
+			CloseRing();
+			return false;
+		}
+		char* sq = (char*)sqmemory;
+		char* cq = (char*)cqmemory;
+		sqtail = (unsigned int*)(sq + params.sq_off.tail);
+		sqmask = (unsigned int*)(sq + params.sq_off.ring_mask);
+		sqarray = (unsigned int*)(sq + params.sq_off.array);
+		cqhead = (unsigned int*)(cq + params.cq_off.head);
+		cqtail = (unsigned int*)(cq + params.cq_off.tail);
+		cqmask = (unsigned int*)(cq + params.cq_off.ring_mask);
+		cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+		vector<iovec> iovecs(buffers.size());
+		for (size_t b = 0; b < buffers.size(); b++)
+		{
+			iovecs[b].iov_base = buffers[b].data;
+			iovecs[b].iov_len = buffersize;
+		}
+		if (syscall(__NR_io_uring_register, ring, IORING_REGISTER_BUFFERS, iovecs.data(), (unsigned int)iovecs.size()) != 0)
+		{
+			CloseRing();
+			return false;
+		}
+		return true;
+	}
+
+	// Queue the write of the rest of a buffer
+	void Queue(int b)
+	{
+		Buffer& buffer = buffers[b];
+		unsigned int tail = *sqtail;
+		unsigned int index = tail & *sqmask;
+		io_uring_sqe& sqe = sqes[index];
+		memset(&sqe, 0, sizeof(sqe));
+		sqe.opcode = IORING_OP_WRITE_FIXED;
+		sqe.fd = fd;
+		sqe.off = (unsigned long long)(buffer.offset + buffer.done);
+		sqe.addr = (unsigned long long)(buffer.data + buffer.done);
+		sqe.len = (unsigned int)(buffer.size - buffer.done);
+		sqe.buf_index = (unsigned short)b;
+		sqe.user_data = (unsigned long long)b;
+		sqarray[index] = index;
+		__atomic_store_n(sqtail, tail + 1, __ATOMIC_RELEASE);
+		pending++;
+		inflight++;
+	}
+
+	// Enter the queued writes, waiting for at least wait of them to complete, and reap the completions
+	void Enter(unsigned int wait)
+	{
+		while (pending > 0 || wait > 0)
+		{
+			int n = (int)syscall(__NR_io_uring_enter, ring, pending, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+			if (n < 0)
+			{
+				if (errno == EINTR) continue;
+				//The ring is broken, finish the buffers in flight with pwrite
+				Abandon();
+				return;
+			}
+			pending -= min(pending, (unsigned int)n);
+			unsigned int reaped = Reap();
+			wait -= min(wait, reaped);
+		}
+	}
+
+	// Handle the completed writes, returns the number of buffers that became free
+	unsigned int Reap()
+	{
+		unsigned int freed = 0;
+		unsigned int head = *cqhead;
+		unsigned int tail = __atomic_load_n(cqtail, __ATOMIC_ACQUIRE);
+		while (head != tail)
+		{
+			io_uring_cqe& cqe = cqes[head & *cqmask];
+			int b = (int)cqe.user_data;
+			int result = cqe.res;
+			head++;
+			inflight--;
+			Buffer& buffer = buffers[b];
+			if (result > 0) buffer.done += result;
+			if (result > 0 && buffer.done < buffer.size)
+			{
+				//Short write, queue the rest
+				Queue(b);
+				continue;
+			}
+			if (result <= 0 && !WriteAt(buffer.data + buffer.done, buffer.size - buffer.done, buffer.offset + buffer.done)) failed = true;
+			Release(b);
+			freed++;
+		}
+		__atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+		return freed;
+	}
+
+	// Write the buffers in flight with pwrite and stop using the ring
+	void Abandon()
+	{
+		for (size_t b = 0; b < buffers.size(); b++)
+		{
+			Buffer& buffer = buffers[b];
+			if (!buffer.busy) continue;
+			if (!WriteAt(buffer.data, buffer.size, buffer.offset)) failed = true;
+			Release((int)b);
+		}
+		CloseRing();
+	}
+#endif
+
+	// Unmap and close the ring
+	void CloseRing()
+	{
+#ifdef ASYNCWRITER_URING
+		if (sqes != nullptr) munmap(sqes, sqessize);
+		if (cqmemory != nullptr && cqmemory != sqmemory) munmap(cqmemory, cqsize);
+		if (sqmemory != nullptr) munmap(sqmemory, sqsize);
+		sqes = nullptr;
+#endif
+		sqmemory = cqmemory = nullptr;
+		if (ring >= 0) close(ring);
+		ring = -1;
+		pending = inflight = 0;
+	}
+
+	// Return a buffer to the free list
+	void Release(int b)
+	{
+		buffers[b].busy = false;
+		freebuffers.push_back(b);
+	}
+
+	// Hand the current buffer to the kernel
+	void Submit()
+	{
+		if (current < 0) return;
+		Buffer& buffer = buffers[current];
+		buffer.size = pptr() - pbase();
+		setp(nullptr, nullptr);
+		if (buffer.size == 0)
+		{
+			Release(current);
+			current = -1;
+			return;
+		}
+		buffer.done = 0;
+		buffer.offset = offset;
+		buffer.busy = true;
+		offset += buffer.size;
+		bytes += buffer.size;
+		Preallocate(offset);
+		int b = current;
+		current = -1;
+#ifdef ASYNCWRITER_URING
+		if (ring >= 0)
+		{
+			Queue(b);
+			if (pending >= batch) Enter(0);
+			return;
+		}
+#endif
+		if (!WriteAt(buffer.data, buffer.size, buffer.offset)) failed = true;
+		Release(b);
+	}
+
+	// Make a free buffer current, waiting for a write to complete if there is none
+	void Acquire()
+	{
+#ifdef ASYNCWRITER_URING
+		if (ring >= 0 && freebuffers.empty()) Enter(1);
+#endif
+		current = freebuffers.back();
+		freebuffers.pop_back();
+		setp(buffers[current].data, buffers[current].data + buffersize);
+	}
+
+protected:
+	// The current buffer is full (or there is none), move on to a new one
+	int overflow(int c)
+	{
+		if (fd < 0) return traits_type::eof();
+		Submit();
+		Acquire();
+		if (c != traits_type::eof())
+		{
+			*pptr() = (char)c;
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+	// Copy a range into the buffers
+	streamsize xsputn(const char* s, streamsize n)
+	{
+		streamsize left = n;
+		while (left > 0)
+		{
+			if (pptr() == epptr() && overflow(traits_type::eof()) == traits_type::eof()) return n - left;
+			streamsize room = min((streamsize)(epptr() - pptr()), left);
+			memcpy(pptr(), s, room);
+			pbump((int)room);
+			s += room;
+			left -= room;
+		}
+		return n;
+	}
+
+	// Flushing the stream leaves the data in the buffers
+	int sync()
+	{
+		return 0;
+	}
+
+public:
+	//Ctor and Dtor
+	AsyncFileWriter(const string& filename, bool uring = true, size_t size = 1 << 14, int count = 16) : stream(this)
+	{
+		buffersize = size;
+		current = -1;
+		bytes = 0;
+		failed = false;
+		preallocate = true;
+		ring = -1;
+		batch = max(1, count / 2);
+		pending = inflight = 0;
+		sqmemory = cqmemory = nullptr;
+		sqsize = cqsize = 0;
+#ifdef ASYNCWRITER_URING
+		sqes = nullptr;
+		sqessize = 0;
+#endif
+		memory = nullptr;
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (fd < 0) return;
+		offset = lseek(fd, 0, SEEK_END);
+		allocated = offset;
+
+		//Page aligned buffers, in one block
+		if (posix_memalign((void**)&memory, 4096, buffersize * count) != 0)
+		{
+			memory = nullptr;
+			close(fd);
+			fd = -1;
+			return;
+		}
+		buffers.resize(count);
+		for (int b = count - 1; b >= 0; b--)
+		{
+			buffers[b].data = memory + b * buffersize;
+			buffers[b].size = buffers[b].done = 0;
+			buffers[b].offset = 0;
+			buffers[b].busy = false;
+			freebuffers.push_back(b);
+		}
+#ifdef ASYNCWRITER_URING
+		if (uring) SetupRing();
+#endif
+	}
+	~AsyncFileWriter()
+	{
+		Flush();
+		CloseRing();
+		//Give back the space preallocated past the end
+		if (fd >= 0 && allocated > offset && ftruncate(fd, offset) != 0) failed = true;
+		if (fd >= 0) close(fd);
+		free(memory);
+	}
+	AsyncFileWriter(const AsyncFileWriter&) = delete;
+	AsyncFileWriter& operator=(const AsyncFileWriter&) = delete;
+
+	// Is the file open
+	bool IsOpen() const
+	{
+		return fd >= 0;
+	}
+
+	// Are the writes going through io_uring
+	bool IsUring() const
+	{
+		return ring >= 0;
+	}
+
+	// Has any write failed
+	bool HasFailed() const
+	{
+		return failed;
+	}
+
+	// Get the stream writing into the file
+	ostream& GetStream()
+	{
+		return stream;
+	}
+
+	// Append bytes to the file
+	void Write(const char* data, size_t size)
+	{
+		xsputn(data, (streamsize)size);
+	}
+
+	// Get room for size bytes in the current buffer to format into, nullptr if it is larger than a buffer
+	// The bytes formatted are appended by Commit
+	char* Reserve(size_t size)
+	{
+		if (fd < 0 || size > buffersize) return nullptr;
+		if ((size_t)(epptr() - pptr()) < size)
+		{
+			Submit();
+			Acquire();
+		}
+		return pptr();
+	}
+
+	// Append size bytes formatted into the room given by Reserve
+	void Commit(size_t size)
+	{
+		pbump((int)size);
+	}
+
+	// Write the current buffer and wait until every buffer is written
+	void Flush()
+	{
+		if (fd < 0) return;
+		Submit();
+#ifdef ASYNCWRITER_URING
+		if (ring >= 0) Enter(inflight);
+#endif
+	}
+
+	// Get the number of bytes handed to the kernel
+	unsigned long long GetBytes() const
+	{
+		return bytes;
+	}
+};
+
+#endif // !ASYNCWRITER_HPP
@@ -0,0 +1,71 @@
+/*
+* algodecision_bench.cpp
+* Times the algo execution decision per book update over 7 bonds with 5-level books: spread too
+* wide, executing at the top of the book, executing with a cooldown, and sweeping the depth
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o algodecision_bench bench/algodecision_bench.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <chrono>
+#include "functionalities.hpp"
+#include "algoexecutionservice.hpp"
+
+// Counts the executions sent
+class ExecutionCounter : public ServiceListener<AlgoExecution<Bond>>
+{
+public:
+	long executions = 0;
+
+	void ProcessAdd(AlgoExecution<Bond>&) { executions++; }
+	void ProcessRemove(AlgoExecution<Bond>&) {}
+	void ProcessUpdate(AlgoExecution<Bond>&) {}
+};
+
+// Books of the 7 bonds with a spread of a number of 256ths
+vector<OrderBook<Bond>> MakeBooks(int spread)
+{
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<OrderBook<Bond>> books;
+	for (auto c = cusips.begin(); c != cusips.end(); c++)
+	{
+		vector<Order> bids, offers;
+		for (int l = 0; l < 5; l++)
+		{
+			bids.push_back(Order(99.0 - l / 256.0, (l + 1) * 1000000L, BID));
+			offers.push_back(Order(99.0 + (spread + l) / 256.0, (l + 1) * 1000000L, OFFER));
+		}
+		books.push_back(OrderBook<Bond>(MakeBond(*c), bids, offers));
+	}
+	return books;
+}
+
+// Time the decisions on the books with a cooldown and a sweep quantity
+void Run(const string& name, const vector<OrderBook<Bond>>& source, long cooldown, long sweep, long updates)
+{
+	AlgoExecutionService<Bond> service;
+	ExecutionCounter counter;
+	service.AddListener(&counter);
+	service.SetCooldown(cooldown);
+	service.SetSweepQuantity(sweep);
+	vector<OrderBook<Bond>> books = source;
+	auto start = chrono::steady_clock::now();
+	for (long u = 0; u < updates; u++)
+	{
+		service.ExecuteOrder(books[u % books.size()]);
+	}
+	auto end = chrono::steady_clock::now();
+	cout << name << ": " << chrono::duration<double, nano>(end - start).count() / updates << " ns per update, "
+		<< counter.executions << " executions" << endl;
+}
+
+int main()
+{
+	const long updates = 7000000;
+	vector<OrderBook<Bond>> wide = MakeBooks(4);
+	vector<OrderBook<Bond>> tight = MakeBooks(1);
+	Run("spread too wide", wide, 0, 0, updates);
+	Run("top of book", tight, 0, 0, updates);
+	Run("top of book, cooldown 3", tight, 3, 0, updates);
+	Run("sweep 6M through the depth", tight, 0, 6000000, updates);
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*
+* algopayload_bench.cpp
+* Tracks the resident memory over 7M algo execution and 7M algo stream events (7 bonds)
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o algopayload_bench bench/algopayload_bench.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "functionalities.hpp"
+#include "algoexecutionservice.hpp"
+#include "algostreamingservice.hpp"
+
+// Get the resident set size in KB
+long ResidentKB()
+{
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main()
+{
+	AlgoExecutionService<Bond> algoexecution;
+	AlgoStreamingService<Bond> algostreaming;
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+
+	//Books at the tightest spread, so that every update sends an execution
+	vector<OrderBook<Bond>> books;
+	vector<Price<Bond>> prices;
+	for (auto c = cusips.begin(); c != cusips.end(); c++)
+	{
+		Bond bond = MakeBond(*c);
+		vector<Order> bids, offers;
+		for (int l = 0; l < 5; l++)
+		{
+			bids.push_back(Order(99.0 - l / 256.0, (l + 1) * 1000000L, BID));
+			offers.push_back(Order(99.0 + (l + 1) / 256.0, (l + 1) * 1000000L, OFFER));
+		}
+		books.push_back(OrderBook<Bond>(bond, bids, offers));
+		prices.push_back(Price<Bond>(bond, 99.0, 1.0 / 128.0));
+	}
+
+	const long events = 7000000;
+	const long step = 1000000;
+	long start = ResidentKB();
+	cout << "events, resident KB" << endl;
+	cout << 0 << ", " << start << endl;
+	auto begin = chrono::steady_clock::now();
+	for (long e = 1; e <= events; e++)
+	{
+		size_t p = e % books.size();
+		algoexecution.ExecuteOrder(books[p]);
+		algostreaming.PublishPrice(prices[p]);
+		if (e % step == 0) cout << e << ", " << ResidentKB() << endl;
+	}
+	auto end = chrono::steady_clock::now();
+	cout << "executions on " << cusips[0] << ": " << algoexecution.GetExecutionCount(cusips[0]) << endl;
+	cout << "growth over the run: " << ResidentKB() - start << " KB" << endl;
+	cout << "per event pair: " << chrono::duration<double, nano>(end - begin).count() / events << " ns" << endl;
+	return 0;
+}
@@ -0,0 +1,83 @@
+/*
+* archivememory_bench.cpp
+* Tracks the resident memory over 3M trades booked and 3M inquiries finished (7 bonds), with the
+* trade and inquiry archives (hot maps of 10000), or with every record kept hot when run as
+* "archivememory_bench hot"; with the archives, what still grows is the duplicate check of the
+* archived trade ids (two bloom filters of 16 bits per id)
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o archivememory_bench bench/archivememory_bench.cpp
+* Run it from a scratch directory: it writes trades.archive and inquiries.archive there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstring>
+#include "functionalities.hpp"
+#include "pricingservice.hpp"
+#include "tradebookingservice.hpp"
+#include "inquiryservice.hpp"
+
+// Get the resident set size in KB
+long ResidentKB()
+{
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+int main(int argc, char* argv[])
+{
+	bool archived = !(argc > 1 && strcmp(argv[1], "hot") == 0);
+	PricingService<Bond> pricing;
+	TradeBookingService<Bond> booking;
+	InquiryService<Bond> inquiry;
+	inquiry.SetPriceSnapshots(&pricing.GetSnapshots());
+	//The client answers in the tick of the quote, so each tick finishes an inquiry
+	inquiry.GetConnector()->SetDelay(0);
+	if (archived)
+	{
+		booking.EnableArchive("trades.archive");
+		booking.SetHotCapacity(10000);
+		inquiry.EnableArchive("inquiries.archive");
+		inquiry.SetHotCapacity(10000);
+	}
+
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++)
+	{
+		bonds.push_back(MakeBond(*c));
+		Price<Bond> price(bonds.back(), 99.0, 1.0 / 128.0);
+		pricing.OnMessage(price);
+	}
+	vector<string> books{ "TRSY1", "TRSY2", "TRSY3" };
+
+	const long events = 3000000;
+	const long step = 500000;
+	long start = ResidentKB();
+	cout << (archived ? "archived" : "all hot") << endl;
+	cout << "trades and inquiries, resident KB" << endl;
+	cout << 0 << ", " << start << endl;
+	auto begin = chrono::steady_clock::now();
+	for (long e = 1; e <= events; e++)
+	{
+		const Bond& bond = bonds[e % bonds.size()];
+		Trade<Bond> trade(bond, GenerateId(), 99.0 + (e % 64) / 256.0, books[e % books.size()], (e % 5 + 1) * 1000000, e % 2 == 0 ? BUY : SELL);
+		booking.OnMessage(trade);
+		Inquiry<Bond> received(GenerateId(), bond, e % 2 == 0 ? BUY : SELL, (e % 5 + 1) * 1000000, 0.0, RECEIVED);
+		inquiry.OnMessage(received);
+		inquiry.GetConnector()->Tick();
+		if (e % step == 0) cout << e << ", " << ResidentKB() << endl;
+	}
+	auto end = chrono::steady_clock::now();
+	cout << "hot trades " << booking.GetHotCount() << ", hot inquiries " << inquiry.GetHotCount() << endl;
+	if (archived)
+	{
+		cout << "archived trades " << booking.GetArchive()->GetSize() << " (" << booking.GetArchive()->GetMemorySize() << " in memory), archived inquiries "
+			<< inquiry.GetArchive()->GetSize() << " (" << inquiry.GetArchive()->GetMemorySize() << " in memory)" << endl;
+	}
+	cout << "growth over the run: " << ResidentKB() - start << " KB in "
+		<< chrono::duration<double>(end - begin).count() << " s" << endl;
+	return 0;
+}
@@ -0,0 +1,101 @@
+/*
+* asyncwriter_bench.cpp
+* Writes 1 GB of 49-byte CSV lines through a buffered ofstream, AsyncFileWriter with pwrite and
+* AsyncFileWriter with io_uring, then 2M price streams formatted by their serializer through
+* the ofstream and through AsyncFileWriter: prints the MB/s, the CPU time of the writing thread
+* and of the whole process (io_uring workers included)
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o asyncwriter_bench bench/asyncwriter_bench.cpp
+* Run it from a scratch directory: it writes bench.out there (removed after each run)
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <sys/resource.h>
+#include "functionalities.hpp"
+#include "algostreamingservice.hpp"
+#include "asyncwriter.hpp"
+
+// Get the CPU seconds spent by the calling thread
+double ThreadCpuSeconds()
+{
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Get the CPU seconds spent by the process
+double ProcessCpuSeconds()
+{
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+// Time a write to bench.out and print the throughput and CPU
+template<typename F>
+void Run(const string& name, F write)
+{
+	remove("bench.out");
+	auto start = chrono::steady_clock::now();
+	double thread = ThreadCpuSeconds();
+	double process = ProcessCpuSeconds();
+	unsigned long long bytes = write();
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << name << ": " << bytes / 1e6 << " MB in " << seconds << " s, " << bytes / 1e6 / seconds << " MB/s, CPU "
+		<< ThreadCpuSeconds() - thread << " s on the writing thread, " << ProcessCpuSeconds() - process << " s in all" << endl;
+	remove("bench.out");
+}
+
+int main()
+{
+	const string line = "TMUBMUSD02Y,98.996094,99.003906,1000000,2000000\n";
+	const size_t nlines = 1000000000 / line.size();
+
+	Run("lines, buffered ofstream", [&]()
+	{
+		ofstream file("bench.out");
+		for (size_t i = 0; i < nlines; i++) file.write(line.data(), line.size());
+		file.close();
+		return (unsigned long long)(nlines * line.size());
+	});
+	for (int uring = 0; uring < 2; uring++)
+	{
+		AsyncFileWriter probe("bench.out", uring == 1);
+		string name = string("lines, AsyncFileWriter with ") + (probe.IsUring() ? "io_uring" : "pwrite");
+		Run(name, [&]()
+		{
+			AsyncFileWriter writer("bench.out", uring == 1);
+			for (size_t i = 0; i < nlines; i++) writer.Write(line.data(), line.size());
+			writer.Flush();
+			return writer.HasFailed() ? 0ULL : writer.GetBytes();
+		});
+	}
+
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<PriceStream<Bond>> streams;
+	const size_t nstreams = 2000000;
+	for (size_t i = 0; i < nstreams; i++)
+	{
+		double mid = 99.0 + (long)(i % 512) / 256.0;
+		streams.push_back(PriceStream<Bond>(MakeBond(cusips[i % cusips.size()]), mid - 1 / 256.0, mid + 1 / 256.0, 1000000, 2000000));
+	}
+	Run("streams, buffered ofstream", [&]()
+	{
+		ofstream file("bench.out");
+		for (auto s = streams.begin(); s != streams.end(); s++) Serialize(file, *s);
+		file.close();
+		ifstream in("bench.out", ios::binary | ios::ate);
+		return (unsigned long long)in.tellg();
+	});
+	Run("streams, AsyncFileWriter", [&]()
+	{
+		AsyncFileWriter writer("bench.out");
+		for (auto s = streams.begin(); s != streams.end(); s++) Serialize(writer.GetStream(), *s);
+		writer.Flush();
+		return writer.HasFailed() ? 0ULL : writer.GetBytes();
+	});
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+* compression_bench.cpp
+* Writes 6M price streams and 2M execution orders (7 bonds, prices on the 1/256 grid) as CSV through
+* one buffered ofstream and as block-compressed files, then reads the compressed files back: prints
+* the sizes, the compression ratio, the write throughput and the CPU time of each thread
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o compression_bench bench/compression_bench.cpp
+* Run it from a scratch directory: it writes streams.csv, streams.cmp, executions.csv and executions.cmp there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <ctime>
+#include "functionalities.hpp"
+#include "algoexecutionservice.hpp"
+#include "algostreamingservice.hpp"
+#include "compressedstore.hpp"
+
+// Get the CPU seconds spent by the calling thread
+double ThreadCpuSeconds()
+{
+	timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+// Get the size of a file in bytes
+long long FileSize(const string& filename)
+{
+	ifstream in(filename, ios::binary | ios::ate);
+	return (long long)in.tellg();
+}
+
+// Write the values as CSV and compressed, then read the compressed file back
+template<typename V>
+void Run(const string& name, const vector<V>& values)
+{
+	string csvname = name + ".csv";
+	string compressedname = name + ".cmp";
+
+	auto start = chrono::steady_clock::now();
+	double cpu = ThreadCpuSeconds();
+	{
+		ofstream csv(csvname);
+		csv << std::fixed << std::setprecision(6);
+		for (auto v = values.begin(); v != values.end(); v++) Serialize(csv, *v);
+	}
+	double csvcpu = ThreadCpuSeconds() - cpu;
+	double csvseconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	start = chrono::steady_clock::now();
+	cpu = ThreadCpuSeconds();
+	double compressorcpu;
+	{
+		CompressedWriter<V> writer(compressedname);
+		for (auto v = values.begin(); v != values.end(); v++) writer.Append(*v);
+		writer.Flush();
+		compressorcpu = writer.GetCpuTime();
+	}
+	double pipelinecpu = ThreadCpuSeconds() - cpu;
+	double compressedseconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	start = chrono::steady_clock::now();
+	size_t rows = 0;
+	{
+		CompressedReader<V> reader(compressedname);
+		ColumnCell row[ColumnarTraits<V>::Columns];
+		while (reader.Next(row)) rows++;
+	}
+	double readseconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+	long long csvbytes = FileSize(csvname);
+	long long compressedbytes = FileSize(compressedname);
+	cout << name << ": " << values.size() << " records" << endl;
+	cout << "  CSV: " << csvbytes / 1e6 << " MB in " << csvseconds << " s (" << csvbytes / 1e6 / csvseconds << " MB/s of CSV), "
+		<< csvcpu << " s of CPU" << endl;
+	cout << "  compressed: " << compressedbytes / 1e6 << " MB in " << compressedseconds << " s (" << csvbytes / 1e6 / compressedseconds
+		<< " MB/s of CSV), " << pipelinecpu << " s of CPU on the pipeline, " << compressorcpu << " s on the compressor" << endl;
+	cout << "  ratio " << (double)csvbytes / compressedbytes << ", " << (double)compressedbytes / values.size() << " bytes per record, "
+		<< rows << " rows read back in " << readseconds << " s" << endl;
+}
+
+int main()
+{
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++) bonds.push_back(MakeBond(*c));
+
+	//Shaped like the generated data: each bond in turn, its mid walking between 99 and 101 by 1/256
+	//with the half spread alternating between 1/256 and 1/128
+	const size_t nstreams = 6000000;
+	vector<PriceStream<Bond>> streams;
+	streams.reserve(nstreams);
+	for (size_t i = 0; i < nstreams; i++)
+	{
+		size_t step = i % (nstreams / bonds.size());
+		long tick = (long)(step % 1024 < 512 ? step % 512 : 512 - step % 512);
+		double mid = 99.0 + tick / 256.0;
+		double half = (step % 2 == 0 ? 1.0 : 2.0) / 256.0;
+		streams.push_back(PriceStream<Bond>(bonds[i * bonds.size() / nstreams], mid - half, mid + half, 1000000, 2000000));
+	}
+	Run("streams", streams);
+	streams = vector<PriceStream<Bond>>();
+
+	//Executions of each bond in turn, crossing the spread of the walking mid, of 1M to 5M
+	const size_t nexecutions = 2000000;
+	vector<ExecutionOrder<Bond>> executions;
+	executions.reserve(nexecutions);
+	for (size_t i = 0; i < nexecutions; i++)
+	{
+		size_t step = i % (nexecutions / bonds.size());
+		long tick = (long)(step % 1024 < 512 ? step % 512 : 512 - step % 512);
+		PricingSide side = step % 2 == 0 ? BID : OFFER;
+		double price = 99.0 + tick / 256.0 + (side == BID ? -1.0 : 1.0) / 256.0;
+		executions.push_back(ExecutionOrder<Bond>(bonds[i * bonds.size() / nexecutions], side, i + 1, MARKET, price, (long)(i % 5 + 1) * 1000000, 0, false));
+	}
+	Run("executions", executions);
+	return 0;
+}
@@ -0,0 +1,74 @@
+/*
+* historyring_bench.cpp
+* Times the in-memory history of price streams: 14M updates over 7 bonds into rings of the last
+* 1k and 1M rows per bond (first filling them, then full), then the mean and variance of the bid
+* over a full ring; prints the memory held by the rings and the resident memory
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o historyring_bench bench/historyring_bench.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include "functionalities.hpp"
+#include "algostreamingservice.hpp"
+#include "historyring.hpp"
+
+// Get the resident set size in KB
+long ResidentKB()
+{
+	ifstream statm("/proc/self/statm");
+	long size = 0, resident = 0;
+	statm >> size >> resident;
+	return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Append the streams to rings of a capacity, then compute over the ring of the first bond
+void Run(const vector<PriceStream<Bond>>& streams, size_t capacity)
+{
+	long startkb = ResidentKB();
+	HistoryStore<PriceStream<Bond>> history(capacity);
+	auto start = chrono::steady_clock::now();
+	for (auto s = streams.begin(); s != streams.end(); s++) history.Append(*s);
+	double appendns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / streams.size();
+	//Again, into rings already full and in memory
+	start = chrono::steady_clock::now();
+	for (auto s = streams.begin(); s != streams.end(); s++) history.Append(*s);
+	double fullns = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / streams.size();
+
+	//Column 2 is the bid price
+	const HistoryRing<PriceStream<Bond>>* ring = history.GetRing(streams[0].GetProduct().GetProductId());
+	const int repeats = capacity < 100000 ? 10000 : 10;
+	double mean = 0, variance = 0;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < repeats; r++) mean += ring->Mean(2, ring->GetCount());
+	double meanus = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeats;
+	start = chrono::steady_clock::now();
+	for (int r = 0; r < repeats; r++) variance += ring->Variance(2, ring->GetCount());
+	double varianceus = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / repeats;
+
+	cout << "N = " << capacity << ": " << appendns << " ns per update filling the rings, " << fullns << " ns once full ("
+		<< 1e3 / fullns << "M updates/s), " << history.GetBytes() / 1e6 << " MB held, resident memory +" << (ResidentKB() - startkb) / 1024 << " MB" << endl;
+	cout << "  over " << ring->GetCount() << " rows: mean " << mean / repeats << " in " << meanus << " us, variance "
+		<< variance / repeats << " in " << varianceus << " us" << endl;
+}
+
+int main()
+{
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++) bonds.push_back(MakeBond(*c));
+
+	//The bonds take turns, 2M updates each, so that the rings of 1M rows wrap
+	const size_t n = 14000000;
+	vector<PriceStream<Bond>> streams;
+	streams.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		double mid = 99.0 + (long)((i / bonds.size()) % 512) / 256.0;
+		streams.push_back(PriceStream<Bond>(bonds[i % bonds.size()], mid - 1 / 256.0, mid + 1 / 256.0, 1000000, 2000000));
+	}
+
+	Run(streams, 1000);
+	Run(streams, 1000000);
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+* inquiryquote_bench.cpp
+* Times 1M inquiries over 7 bonds through InquiryService: received, quoted from the live price,
+* accepted by the client and finished, one inquiry per tick; with static prices, then with a
+* thread writing prices all along
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o inquiryquote_bench bench/inquiryquote_bench.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include "functionalities.hpp"
+#include "pricingservice.hpp"
+#include "inquiryservice.hpp"
+
+// Counts the inquiries finished as DONE
+class DoneCounter : public ServiceListener<Inquiry<Bond>>
+{
+public:
+	long done = 0;
+
+	void ProcessAdd(Inquiry<Bond>& data) { if (data.GetState() == DONE) done++; }
+	void ProcessRemove(Inquiry<Bond>&) {}
+	void ProcessUpdate(Inquiry<Bond>&) {}
+};
+
+// Run the inquiries, with or without a thread writing prices meanwhile
+void Run(bool livepricing)
+{
+	PricingService<Bond> pricing;
+	InquiryService<Bond> inquiry;
+	DoneCounter counter;
+	inquiry.AddListener(&counter);
+	inquiry.SetPriceSnapshots(&pricing.GetSnapshots());
+	//The client answers in the tick of the quote, so each tick runs an inquiry to its end
+	inquiry.GetConnector()->SetDelay(0);
+
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++)
+	{
+		bonds.push_back(MakeBond(*c));
+		Price<Bond> price(bonds.back(), 99.0, 1.0 / 128.0);
+		pricing.OnMessage(price);
+	}
+
+	//The inquiries are made up front, so that only the service is timed
+	const size_t n = 1000000;
+	vector<Inquiry<Bond>> inquiries;
+	inquiries.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		inquiries.push_back(Inquiry<Bond>(GenerateId(), bonds[i % bonds.size()], i % 2 == 0 ? BUY : SELL, (long)(i % 5 + 1) * 1000000, 0.0, RECEIVED));
+	}
+
+	//The pricing thread is the only one touching the pricing service, the inquiries read its snapshots
+	atomic<bool> stop(false);
+	long updates = 0;
+	thread writer;
+	if (livepricing)
+	{
+		writer = thread([&]()
+		{
+			for (long u = 0; !stop.load(memory_order_relaxed); u++, updates++)
+			{
+				Price<Bond> price(bonds[u % bonds.size()], 99.0 + (u % 64) / 256.0, 1.0 / 128.0);
+				pricing.OnMessage(price);
+			}
+		});
+	}
+
+	vector<double> latencies(n);
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < n; i++)
+	{
+		auto begin = chrono::steady_clock::now();
+		inquiry.OnMessage(inquiries[i]);
+		inquiry.GetConnector()->Tick();
+		latencies[i] = chrono::duration<double, nano>(chrono::steady_clock::now() - begin).count();
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	stop.store(true);
+	if (writer.joinable()) writer.join();
+
+	sort(latencies.begin(), latencies.end());
+	cout << (livepricing ? "live prices" : "static prices") << ": " << n << " inquiries, " << counter.done << " done, "
+		<< inquiry.GetLiveCount() << " in flight, " << updates << " price updates" << endl;
+	cout << "  throughput " << n / seconds / 1e6 << "M inquiries/s, latency from receipt to finish: p50 "
+		<< latencies[n / 2] << " ns, p99 " << latencies[n * 99 / 100] << " ns, max " << latencies[n - 1] << " ns" << endl;
+}
+
+int main()
+{
+	Run(false);
+	Run(true);
+	return 0;
+}
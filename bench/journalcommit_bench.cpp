@@ -0,0 +1,65 @@
+/*
+* journalcommit_bench.cpp
+* Times the trade journal: the append and commit cost per trade by fsync policy and group size,
+* then the recovery of 2M journaled trades into PositionService
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o journalcommit_bench bench/journalcommit_bench.cpp
+* Run it from a scratch directory: it writes bench.journal there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include "functionalities.hpp"
+#include "positionservice.hpp"
+
+// Append records to a new journal and print the time per record
+void Run(const string& name, const vector<TradeRecord>& records, size_t count, FsyncPolicy policy, size_t group)
+{
+	remove("bench.journal");
+	Journal<TradeRecord> journal("bench.journal", policy, group);
+	auto start = chrono::steady_clock::now();
+	for (size_t i = 0; i < count; i++)
+	{
+		journal.Append(records[i]);
+	}
+	bool committed = journal.Commit();
+	auto end = chrono::steady_clock::now();
+	cout << name << ": " << chrono::duration<double, nano>(end - start).count() / count << " ns per trade over "
+		<< count << " trades" << (committed ? "" : ", COMMIT FAILED") << endl;
+}
+
+int main()
+{
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<string> books{ "TRSY1", "TRSY2", "TRSY3" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++) bonds.push_back(MakeBond(*c));
+
+	const size_t n = 2000000;
+	vector<TradeRecord> records;
+	records.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		Trade<Bond> trade(bonds[i % bonds.size()], GenerateId(), 99.0 + (i % 64) / 256.0, books[i % books.size()], (long)(i % 5 + 1) * 1000000, i % 2 == 0 ? BUY : SELL);
+		records.push_back(MakeTradeRecord(trade));
+	}
+
+	//A sync per commit is slow, fewer trades are enough to time the small groups
+	Run("no sync, groups of 256", records, n, FSYNC_NEVER, 256);
+	Run("synced every trade", records, 2000, FSYNC_EVERY, 1);
+	Run("synced every 16", records, 20000, FSYNC_GROUP, 16);
+	Run("synced every 256", records, 200000, FSYNC_GROUP, 256);
+	Run("synced every 4096", records, n, FSYNC_GROUP, 4096);
+
+	//Recovery of the whole journal into the positions
+	Run("journal for recovery", records, n, FSYNC_NEVER, 4096);
+	TradeBookingService<Bond> booking;
+	PositionService<Bond> positions;
+	booking.AddListener(positions.GetTradeBookingListener());
+	auto start = chrono::steady_clock::now();
+	unsigned long long replayed = booking.Recover("bench.journal");
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "recovered " << replayed << " trades in " << seconds << " s, " << replayed / seconds / 1e6 << "M trades/s" << endl;
+	remove("bench.journal");
+	return 0;
+}
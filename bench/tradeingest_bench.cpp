@@ -0,0 +1,83 @@
+/*
+* tradeingest_bench.cpp
+* Times the per-trade ingest of TradeBookingService into PositionService over 1M trades (7 bonds):
+* new trades, the same trades sent again (dropped as duplicates), with the archive (resending
+* archived trades), and with the journal
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o tradeingest_bench bench/tradeingest_bench.cpp
+* Run it from a scratch directory: it writes trades.archive and trades.journal there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <chrono>
+#include <cstdio>
+#include "functionalities.hpp"
+#include "positionservice.hpp"
+
+// Book trades from first to last and print the time per trade
+void Book(const string& name, TradeBookingService<Bond>& booking, vector<Trade<Bond>>& trades, size_t first, size_t last)
+{
+	long duplicates = booking.GetDuplicateCount();
+	auto start = chrono::steady_clock::now();
+	for (size_t i = first; i < last; i++)
+	{
+		booking.OnMessage(trades[i]);
+	}
+	booking.CommitJournal();
+	auto end = chrono::steady_clock::now();
+	cout << name << ": " << chrono::duration<double, nano>(end - start).count() / (last - first) << " ns per trade, "
+		<< booking.GetDuplicateCount() - duplicates << " duplicates dropped" << endl;
+}
+
+int main()
+{
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<string> books{ "TRSY1", "TRSY2", "TRSY3" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++) bonds.push_back(MakeBond(*c));
+
+	//The trades are made up front, so that only the services are timed
+	const size_t n = 1000000;
+	vector<Trade<Bond>> trades;
+	trades.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		trades.push_back(Trade<Bond>(bonds[i % bonds.size()], GenerateId(), 99.0 + (i % 64) / 256.0, books[i % books.size()], (long)(i % 5 + 1) * 1000000, i % 2 == 0 ? BUY : SELL));
+	}
+
+	{
+		TradeBookingService<Bond> booking;
+		PositionService<Bond> positions;
+		booking.AddListener(positions.GetTradeBookingListener());
+		Book("new trades", booking, trades, 0, n);
+		Book("sent again", booking, trades, 0, n);
+	}
+
+	//Only the last 10000 trades stay hot, the first ones are checked in the archive when sent again
+	{
+		TradeBookingService<Bond> booking;
+		PositionService<Bond> positions;
+		booking.AddListener(positions.GetTradeBookingListener());
+		booking.EnableArchive("trades.archive");
+		booking.SetHotCapacity(10000);
+		Book("new trades, archived", booking, trades, 0, n);
+		Book("hot trades sent again", booking, trades, n - 10000, n);
+		Book("archived trades sent again", booking, trades, 0, 10000);
+	}
+
+	//A journal written from scratch
+	for (int p = 0; p < 3; p++)
+	{
+		FsyncPolicy policy = p == 0 ? FSYNC_NEVER : (p == 1 ? FSYNC_GROUP : FSYNC_EVERY);
+		remove("trades.journal");
+		TradeBookingService<Bond> booking;
+		PositionService<Bond> positions;
+		booking.AddListener(positions.GetTradeBookingListener());
+		booking.EnableJournal("trades.journal", policy, 256);
+		//A sync per trade is slow, fewer trades are enough to time it
+		size_t count = policy == FSYNC_EVERY ? 10000 : n;
+		Book(p == 0 ? "new trades, journal without sync" : (p == 1 ? "new trades, journal synced every 256" : "new trades, journal synced every trade"),
+			booking, trades, 0, count);
+	}
+	remove("trades.journal");
+	return 0;
+}
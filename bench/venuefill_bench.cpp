@@ -0,0 +1,80 @@
+/*
+* venuefill_bench.cpp
+* Times the simulated venue: 7 bonds with 5-level books, each book update followed by
+* 4 MARKET/IOC/LIMIT orders, with and without fill latency
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o venuefill_bench bench/venuefill_bench.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <chrono>
+#include "functionalities.hpp"
+#include "venueservice.hpp"
+
+// Counts the fills and cancels published by the venue
+class FillCounter : public ServiceListener<Fill<Bond>>
+{
+public:
+	long fills = 0;
+	long cancels = 0;
+
+	void ProcessAdd(Fill<Bond>&) { fills++; }
+	void ProcessRemove(Fill<Bond>&) { cancels++; }
+	void ProcessUpdate(Fill<Bond>&) {}
+};
+
+// Run the orders through a venue with a latency and print the throughput
+void Run(long latency, long updates)
+{
+	VenueService<Bond> venue;
+	FillCounter counter;
+	venue.AddListener(&counter);
+	venue.SetLatency(latency);
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+
+	vector<OrderBook<Bond>> books;
+	for (auto c = cusips.begin(); c != cusips.end(); c++)
+	{
+		vector<Order> bids, offers;
+		for (int l = 0; l < 5; l++)
+		{
+			bids.push_back(Order(99.0 - l / 256.0, (l + 1) * 1000000L, BID));
+			offers.push_back(Order(99.0 + (l + 1) / 256.0, (l + 1) * 1000000L, OFFER));
+		}
+		books.push_back(OrderBook<Bond>(MakeBond(*c), bids, offers));
+	}
+
+	//The orders sent after each update: a market order over two levels, an IOC order partly filled,
+	//an IOC order finding nothing, and a LIMIT order that does not cross, rests and is cancelled
+	vector<vector<ExecutionOrder<Bond>>> orders(books.size());
+	for (size_t b = 0; b < books.size(); b++)
+	{
+		const Bond& bond = books[b].GetProduct();
+		orders[b].push_back(ExecutionOrder<Bond>(bond, BID, 1, MARKET, 0.0, 2500000, 0, false));
+		orders[b].push_back(ExecutionOrder<Bond>(bond, OFFER, 2, IOC, 99.0 + 2 / 256.0, 4000000, 0, false));
+		orders[b].push_back(ExecutionOrder<Bond>(bond, OFFER, 3, IOC, 99.0 + 1 / 256.0, 500000, 0, false));
+		orders[b].push_back(ExecutionOrder<Bond>(bond, BID, 4, LIMIT, 99.0 + 8 / 256.0, 1000000, 0, false));
+	}
+
+	auto start = chrono::steady_clock::now();
+	for (long u = 0; u < updates; u++)
+	{
+		size_t b = u % books.size();
+		venue.UpdateBook(books[b]);
+		for (auto o = orders[b].begin(); o != orders[b].end(); o++) venue.SubmitOrder(*o);
+		venue.CancelOrder(orders[b].back());
+	}
+	auto end = chrono::steady_clock::now();
+	double seconds = chrono::duration<double>(end - start).count();
+	long operations = updates * (1 + orders[0].size() + 1);
+	cout << "latency " << latency << ": " << operations << " operations (book updates, orders, cancels), "
+		<< counter.fills << " fills, " << counter.cancels << " cancels in " << seconds * 1000 << " ms, "
+		<< operations / seconds / 1e6 << "M operations/s" << endl;
+}
+
+int main()
+{
+	const long updates = 2000000;
+	Run(0, updates);
+	Run(3, updates);
+	return 0;
+}
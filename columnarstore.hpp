@@ -0,0 +1,689 @@
+/*
+* columnarstore.hpp
+* Columnar binary store of historical data, with a block index and SIMD column scans
+* Author: Tengxiao Fan
+*/
+
+#ifndef COLUMNARSTORE_HPP
+#define COLUMNARSTORE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// Type of a column; strings are stored as codes into the dictionary of the store
+enum ColumnType { COLUMN_INT64, COLUMN_FLOAT64, COLUMN_STRING };
+
+// A column: its name (the suffix of its file) and its type
+struct ColumnSpec
+{
+	const char* name;
+	ColumnType type;
+};
+
+// A fixed-width cell of a column
+union ColumnCell
+{
+	long long i;
+	double d;
+};
+
+// Index entry of a block: its first and last timestamp and its number of rows
+struct ColumnBlock
+{
+	long long first;
+	long long last;
+	unsigned int rows;
+	unsigned int reserved;
+};
+
+// Index entry of a product in a block: the first and last row of the block holding it
+struct ColumnProductBlock
+{
+	long long product;
+	unsigned long long block;
+	unsigned int first;
+	unsigned int last;
+};
+
+/*
+* Traits mapping a data type onto columns: GetColumns lists them (the first one is the timestamp
+* and the second one the product) and Write appends the rows of a value to a writer.
+* Types without traits have no columns.
+*/
+template<typename V>
+struct ColumnarTraits
+{
+	static const int Columns = 0;
+	static const ColumnSpec* GetColumns()
+	{
+		return nullptr;
+	}
+	template<typename W>
+	static void Write(W&, long long, const V&) {}
+};
+
+// Current time in nanoseconds since the epoch
+long long ColumnarTimestamp()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Sum of a double column
+double ScanSum(const double* values, size_t n)
+{
+	size_t i = 0;
+	double sum = 0;
+#if defined(__AVX2__)
+	__m256d acc = _mm256_setzero_pd();
+	for (; i + 4 <= n; i += 4) acc = _mm256_add_pd(acc, _mm256_loadu_pd(values + i));
+	double lanes[4];
+	_mm256_storeu_pd(lanes, acc);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128d acc = _mm_setzero_pd();
+	for (; i + 2 <= n; i += 2) acc = _mm_add_pd(acc, _mm_loadu_pd(values + i));
+	double lanes[2];
+	_mm_storeu_pd(lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++) sum += values[i];
+	return sum;
+}
+
+// Sum of an integer column
+long long ScanSum(const long long* values, size_t n)
+{
+	size_t i = 0;
+	long long sum = 0;
+#if defined(__AVX2__)
+	__m256i acc = _mm256_setzero_si256();
+	for (; i + 4 <= n; i += 4) acc = _mm256_add_epi64(acc, _mm256_loadu_si256((const __m256i*)(values + i)));
+	long long lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 2 <= n; i += 2) acc = _mm_add_epi64(acc, _mm_loadu_si128((const __m128i*)(values + i)));
+	long long lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++) sum += values[i];
+	return sum;
+}
+
+#if defined(__SSE2__) && !defined(__AVX2__)
+// Lanes of two 64-bit integer vectors that are equal, as all ones (SSE2 only compares 32-bit lanes)
+__m128i CompareEqual64(__m128i a, __m128i b)
+{
+	__m128i eq = _mm_cmpeq_epi32(a, b);
+	return _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+}
+#endif
+
+// Number of rows of an integer (or string code) column equal to a key
+unsigned long long ScanCount(const long long* keys, size_t n, long long key)
+{
+	size_t i = 0;
+	unsigned long long count = 0;
+#if defined(__AVX2__)
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256i acc = _mm256_setzero_si256();
+	for (; i + 4 <= n; i += 4) acc = _mm256_sub_epi64(acc, _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(keys + i)), k));
+	long long lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+	__m128i k = _mm_set1_epi64x(key);
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 2 <= n; i += 2) acc = _mm_sub_epi64(acc, CompareEqual64(_mm_loadu_si128((const __m128i*)(keys + i)), k));
+	long long lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	count = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++) count += keys[i] == key;
+	return count;
+}
+
+// Sum of a double column over the rows whose key equals a key
+double ScanSumWhere(const double* values, const long long* keys, size_t n, long long key)
+{
+	size_t i = 0;
+	double sum = 0;
+#if defined(__AVX2__)
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256d acc = _mm256_setzero_pd();
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256d mask = _mm256_castsi256_pd(_mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(keys + i)), k));
+		acc = _mm256_add_pd(acc, _mm256_and_pd(mask, _mm256_loadu_pd(values + i)));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, acc);
+	sum = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#elif defined(__SSE2__)
+	__m128i k = _mm_set1_epi64x(key);
+	__m128d acc = _mm_setzero_pd();
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128d mask = _mm_castsi128_pd(CompareEqual64(_mm_loadu_si128((const __m128i*)(keys + i)), k));
+		acc = _mm_add_pd(acc, _mm_and_pd(mask, _mm_loadu_pd(values + i)));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++) sum += keys[i] == key ? values[i] : 0.0;
+	return sum;
+}
+
+// Sum of an integer column over the rows whose key equals a key
+long long ScanSumWhere(const long long* values, const long long* keys, size_t n, long long key)
+{
+	size_t i = 0;
+	long long sum = 0;
+#if defined(__AVX2__)
+	__m256i k = _mm256_set1_epi64x(key);
+	__m256i acc = _mm256_setzero_si256();
+	for (; i + 4 <= n; i += 4)
+	{
+		__m256i mask = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)(keys + i)), k);
+		acc = _mm256_add_epi64(acc, _mm256_and_si256(mask, _mm256_loadu_si256((const __m256i*)(values + i))));
+	}
+	long long lanes[4];
+	_mm256_storeu_si256((__m256i*)lanes, acc);
+	sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+	__m128i k = _mm_set1_epi64x(key);
+	__m128i acc = _mm_setzero_si128();
+	for (; i + 2 <= n; i += 2)
+	{
+		__m128i mask = CompareEqual64(_mm_loadu_si128((const __m128i*)(keys + i)), k);
+		acc = _mm_add_epi64(acc, _mm_and_si128(mask, _mm_loadu_si128((const __m128i*)(values + i))));
+	}
+	long long lanes[2];
+	_mm_storeu_si128((__m128i*)lanes, acc);
+	sum = lanes[0] + lanes[1];
+#endif
+	for (; i < n; i++) sum += keys[i] == key ? values[i] : 0;
+	return sum;
+}
+
+/*
+* File layout shared by the writer and the reader of a columnar store with base name base:
+* base.<column>.col holds one column, a header and then fixed-size blocks of 8-byte cells
+* (only the last block may be partial), so block b of any column is at a computed offset;
+* base.idx holds a header and the index entry (ColumnBlock) of each block;
+* base.pidx holds the sparse product index, an entry (ColumnProductBlock) for each product in each block,
+* where a later entry for the same product and block (the partial block rewritten) replaces an earlier one;
+* base.dict holds the strings of the string columns, a length and the bytes each, coded by order.
+*/
+struct ColumnarHeader
+{
+	unsigned int magic;
+	unsigned int type;
+	unsigned int rowsperblock;
+	unsigned int columns;
+};
+const unsigned int ColumnMagic = 0x534C4F43;
+const unsigned int IndexMagic = 0x494C4F43;
+
+// Offset of a block in a column file
+off_t ColumnOffset(size_t rowsperblock, unsigned long long block)
+{
+	return (off_t)(sizeof(ColumnarHeader) + block * rowsperblock * sizeof(ColumnCell));
+}
+
+// Write a whole buffer at an offset
+bool WriteAt(int fd, const void* data, size_t size, off_t offset)
+{
+	const char* p = (const char*)data;
+	while (size > 0)
+	{
+		ssize_t n = pwrite(fd, p, size, offset);
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+		offset += n;
+	}
+	return true;
+}
+
+// Read a whole buffer at an offset
+bool ReadAt(int fd, void* data, size_t size, off_t offset)
+{
+	char* p = (char*)data;
+	while (size > 0)
+	{
+		ssize_t n = pread(fd, p, size, offset);
+		if (n <= 0) return false;
+		p += n;
+		size -= n;
+		offset += n;
+	}
+	return true;
+}
+
+/*
+* Writer of a columnar store of a data type.
+* Rows are buffered per column and written one block at a time, with the index entry of the block.
+* Flush writes the current partial block, which keeps filling up and is rewritten in place.
+* Timestamps (the first column) are kept non-decreasing so the index can be searched by time.
+*/
+template<typename V>
+class ColumnarWriter
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	size_t rowsperblock;
+	vector<int> files;
+	int indexfile;
+	int dictfile;
+	vector<vector<ColumnCell>> blocks;
+	size_t rows;
+	unsigned long long blockcount;
+	unsigned long long rowcount;
+	long long lasttimestamp;
+	unordered_map<string, long long> codes;
+	vector<char> pendingstrings;
+	int productfile;
+	off_t productoffset;
+	vector<ColumnProductBlock> products;
+	vector<int> productslots;
+
+	// Write the current block of every column and its index entries
+	void WriteBlock()
+	{
+		if (!pendingstrings.empty())
+		{
+			if (write(dictfile, pendingstrings.data(), pendingstrings.size()) != (ssize_t)pendingstrings.size()) return;
+			pendingstrings.clear();
+		}
+		if (rows == 0) return;
+		for (int c = 0; c < Traits::Columns; c++)
+		{
+			WriteAt(files[c], blocks[c].data(), rows * sizeof(ColumnCell), ColumnOffset(rowsperblock, blockcount));
+		}
+		ColumnBlock entry;
+		entry.first = blocks[0][0].i;
+		entry.last = blocks[0][rows - 1].i;
+		entry.rows = (unsigned int)rows;
+		entry.reserved = 0;
+		WriteAt(indexfile, &entry, sizeof(entry), (off_t)(sizeof(ColumnarHeader) + blockcount * sizeof(ColumnBlock)));
+
+		//Rows of each product in the block
+		products.clear();
+		productslots.resize(codes.size());
+		for (size_t r = 0; r < rows; r++)
+		{
+			long long product = blocks[1][r].i;
+			if (product < 0 || product >= (long long)productslots.size()) continue;
+			int& slot = productslots[product];
+			if (slot <= 0 || slot > (int)products.size() || products[slot - 1].product != product)
+			{
+				ColumnProductBlock p;
+				p.product = product;
+				p.block = blockcount;
+				p.first = (unsigned int)r;
+				products.push_back(p);
+				slot = (int)products.size();
+			}
+			products[slot - 1].last = (unsigned int)r;
+		}
+		size_t size = products.size() * sizeof(ColumnProductBlock);
+		if (size > 0 && WriteAt(productfile, products.data(), size, productoffset)) productoffset += size;
+	}
+
+public:
+	//Ctor and Dtor
+	ColumnarWriter(const string& base, size_t blockrows = 4096)
+	{
+		rowsperblock = blockrows > 0 ? blockrows : 1;
+		rows = 0;
+		blockcount = 0;
+		rowcount = 0;
+		lasttimestamp = 0;
+		const ColumnSpec* columns = Traits::GetColumns();
+		ColumnarHeader header;
+		header.magic = ColumnMagic;
+		header.rowsperblock = (unsigned int)rowsperblock;
+		header.columns = Traits::Columns;
+		for (int c = 0; c < Traits::Columns; c++)
+		{
+			int fd = open((base + "." + columns[c].name + ".col").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			header.type = columns[c].type;
+			if (fd >= 0) WriteAt(fd, &header, sizeof(header), 0);
+			files.push_back(fd);
+			blocks.push_back(vector<ColumnCell>(rowsperblock));
+		}
+		indexfile = open((base + ".idx").c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		header.magic = IndexMagic;
+		header.type = 0;
+		if (indexfile >= 0) WriteAt(indexfile, &header, sizeof(header), 0);
+		dictfile = open((base + ".dict").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		productfile = open((base + ".pidx").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		productoffset = 0;
+	}
+	~ColumnarWriter()
+	{
+		Flush();
+		for (auto f = files.begin(); f != files.end(); f++)
+		{
+			if (*f >= 0) close(*f);
+		}
+		if (indexfile >= 0) close(indexfile);
+		if (dictfile >= 0) close(dictfile);
+		if (productfile >= 0) close(productfile);
+	}
+	ColumnarWriter(const ColumnarWriter&) = delete;
+	ColumnarWriter& operator=(const ColumnarWriter&) = delete;
+
+	// Are all the files of the store open
+	bool IsOpen() const
+	{
+		for (auto f = files.begin(); f != files.end(); f++)
+		{
+			if (*f < 0) return false;
+		}
+		return Traits::Columns > 1 && indexfile >= 0 && dictfile >= 0 && productfile >= 0;
+	}
+
+	// Get the code of a string, adding it to the dictionary if it is new
+	long long Code(const string& s)
+	{
+		auto it = codes.find(s);
+		if (it != codes.end()) return it->second;
+		long long code = (long long)codes.size();
+		codes[s] = code;
+		unsigned int size = (unsigned int)s.size();
+		const char* p = (const char*)&size;
+		pendingstrings.insert(pendingstrings.end(), p, p + sizeof(size));
+		pendingstrings.insert(pendingstrings.end(), s.begin(), s.end());
+		return code;
+	}
+
+	// Append a row, one cell per column
+	void AppendRow(const ColumnCell* row)
+	{
+		for (int c = 0; c < Traits::Columns; c++)
+		{
+			blocks[c][rows] = row[c];
+		}
+		if (blocks[0][rows].i < lasttimestamp) blocks[0][rows].i = lasttimestamp;
+		lasttimestamp = blocks[0][rows].i;
+		rows++;
+		rowcount++;
+		if (rows == rowsperblock)
+		{
+			WriteBlock();
+			blockcount++;
+			rows = 0;
+		}
+	}
+
+	// Append the rows of a value
+	void Append(const V& data, long long timestamp)
+	{
+		Traits::Write(*this, timestamp, data);
+	}
+
+	// Append the rows of a value, stamped now
+	void Append(const V& data)
+	{
+		Traits::Write(*this, ColumnarTimestamp(), data);
+	}
+
+	// Write the partial block and the new strings
+	void Flush()
+	{
+		WriteBlock();
+	}
+
+	// Get the number of rows written
+	unsigned long long GetRowCount() const
+	{
+		return rowcount;
+	}
+};
+
+/*
+* Reader of a columnar store of a data type, scanning whole columns a block at a time,
+* or querying the rows of a product in a time range through the block and product indexes.
+*/
+template<typename V>
+class ColumnarReader
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	size_t rowsperblock;
+	vector<int> files;
+	vector<ColumnType> types;
+	vector<ColumnBlock> index;
+	unordered_map<long long, vector<ColumnProductBlock>> productindex;
+	vector<string> strings;
+	unordered_map<string, long long> codes;
+	unsigned long long rowcount;
+	mutable vector<ColumnCell> values;
+	mutable vector<ColumnCell> keys;
+
+	// Read the whole of a file
+	static vector<char> ReadFile(const string& filename)
+	{
+		vector<char> data;
+		int in = open(filename.c_str(), O_RDONLY);
+		if (in < 0) return data;
+		off_t size = lseek(in, 0, SEEK_END);
+		if (size > 0)
+		{
+			data.resize(size);
+			if (!ReadAt(in, data.data(), data.size(), 0)) data.clear();
+		}
+		close(in);
+		return data;
+	}
+
+public:
+	//Ctor and Dtor
+	ColumnarReader(const string& base)
+	{
+		rowsperblock = 1;
+		rowcount = 0;
+		const ColumnSpec* columns = Traits::GetColumns();
+		for (int c = 0; c < Traits::Columns; c++)
+		{
+			files.push_back(open((base + "." + columns[c].name + ".col").c_str(), O_RDONLY));
+			types.push_back(columns[c].type);
+		}
+
+		vector<char> idx = ReadFile(base + ".idx");
+		if (idx.size() >= sizeof(ColumnarHeader))
+		{
+			ColumnarHeader header;
+			memcpy(&header, idx.data(), sizeof(header));
+			if (header.magic == IndexMagic && header.rowsperblock > 0 && (int)header.columns == Traits::Columns)
+			{
+				rowsperblock = header.rowsperblock;
+				size_t blocks = (idx.size() - sizeof(header)) / sizeof(ColumnBlock);
+				index.resize(blocks);
+				memcpy(index.data(), idx.data() + sizeof(header), blocks * sizeof(ColumnBlock));
+				for (auto b = index.begin(); b != index.end(); b++) rowcount += b->rows;
+			}
+		}
+
+		vector<char> dict = ReadFile(base + ".dict");
+		size_t offset = 0;
+		while (offset + sizeof(unsigned int) <= dict.size())
+		{
+			unsigned int size;
+			memcpy(&size, dict.data() + offset, sizeof(size));
+			offset += sizeof(size);
+			if (offset + size > dict.size()) break;
+			codes[string(dict.data() + offset, size)] = (long long)strings.size();
+			strings.push_back(string(dict.data() + offset, size));
+			offset += size;
+		}
+		vector<char> pidx = ReadFile(base + ".pidx");
+		for (size_t offset = 0; offset + sizeof(ColumnProductBlock) <= pidx.size(); offset += sizeof(ColumnProductBlock))
+		{
+			ColumnProductBlock entry;
+			memcpy(&entry, pidx.data() + offset, sizeof(entry));
+			if (entry.block >= index.size()) continue;
+			vector<ColumnProductBlock>& entries = productindex[entry.product];
+			if (!entries.empty() && entries.back().block == entry.block) entries.back() = entry;
+			else entries.push_back(entry);
+		}
+		values.resize(rowsperblock);
+		keys.resize(rowsperblock);
+	}
+	~ColumnarReader()
+	{
+		for (auto f = files.begin(); f != files.end(); f++)
+		{
+			if (*f >= 0) close(*f);
+		}
+	}
+	ColumnarReader(const ColumnarReader&) = delete;
+	ColumnarReader& operator=(const ColumnarReader&) = delete;
+
+	// Get the number of rows
+	unsigned long long GetRowCount() const
+	{
+		return rowcount;
+	}
+
+	// Get the index of the blocks
+	const vector<ColumnBlock>& GetIndex() const
+	{
+		return index;
+	}
+
+	// Get a column by name, -1 if there is none
+	int GetColumn(const string& name) const
+	{
+		const ColumnSpec* columns = Traits::GetColumns();
+		for (int c = 0; c < Traits::Columns; c++)
+		{
+			if (name == columns[c].name) return c;
+		}
+		return -1;
+	}
+
+	// Get the code of a string, -1 if it is not in the store
+	long long GetCode(const string& s) const
+	{
+		auto it = codes.find(s);
+		return it == codes.end() ? -1 : it->second;
+	}
+
+	// Get the string of a code
+	const string& GetString(long long code) const
+	{
+		return strings[code];
+	}
+
+	// Read a block of a column, returns its number of rows (0 on error)
+	size_t ReadBlock(int column, size_t block, vector<ColumnCell>& cells) const
+	{
+		if (column < 0 || column >= Traits::Columns || files[column] < 0 || block >= index.size()) return 0;
+		size_t n = index[block].rows;
+		cells.resize(max(cells.size(), n));
+		if (!ReadAt(files[column], cells.data(), n * sizeof(ColumnCell), ColumnOffset(rowsperblock, block))) return 0;
+		return n;
+	}
+
+	// Get the rows (row-major, one cell per column) of a product with a timestamp in [from, to],
+	// reading only the row ranges of the product in the blocks overlapping the range; returns their number
+	size_t Query(const string& product, long long from, long long to, vector<ColumnCell>& rows) const
+	{
+		rows.clear();
+		auto it = productindex.find(GetCode(product));
+		if (it == productindex.end() || from > to) return 0;
+		const vector<ColumnProductBlock>& entries = it->second;
+		const int n = Traits::Columns;
+
+		//First block of the product that may end at or after from (the last timestamps are non-decreasing)
+		size_t lo = 0, hi = entries.size();
+		while (lo < hi)
+		{
+			size_t mid = (lo + hi) / 2;
+			if (index[entries[mid].block].last < from) lo = mid + 1;
+			else hi = mid;
+		}
+
+		vector<ColumnCell> range;
+		for (size_t e = lo; e < entries.size() && index[entries[e].block].first <= to; e++)
+		{
+			const ColumnProductBlock& entry = entries[e];
+			size_t count = entry.last - entry.first + 1;
+			off_t offset = ColumnOffset(rowsperblock, entry.block) + (off_t)entry.first * sizeof(ColumnCell);
+			range.resize(count * n);
+			for (int c = 0; c < n; c++)
+			{
+				if (!ReadAt(files[c], values.data(), count * sizeof(ColumnCell), offset)) return rows.size() / n;
+				for (size_t r = 0; r < count; r++) range[r * n + c] = values[r];
+			}
+			for (size_t r = 0; r < count; r++)
+			{
+				const ColumnCell* row = &range[r * n];
+				if (row[1].i == entry.product && row[0].i >= from && row[0].i <= to) rows.insert(rows.end(), row, row + n);
+			}
+		}
+		return rows.size() / n;
+	}
+
+	// Sum of a numeric column
+	double Sum(int column) const
+	{
+		double sum = 0;
+		if (column < 0 || column >= Traits::Columns) return sum;
+		for (size_t b = 0; b < index.size(); b++)
+		{
+			size_t n = ReadBlock(column, b, values);
+			if (types[column] == COLUMN_FLOAT64) sum += ScanSum(&values[0].d, n);
+			else sum += (double)ScanSum(&values[0].i, n);
+		}
+		return sum;
+	}
+
+	// Number of rows of an integer or string column equal to a value (a code for strings)
+	unsigned long long Count(int column, long long value) const
+	{
+		unsigned long long count = 0;
+		for (size_t b = 0; b < index.size(); b++)
+		{
+			size_t n = ReadBlock(column, b, keys);
+			count += ScanCount(&keys[0].i, n, value);
+		}
+		return count;
+	}
+
+	// Sum of a numeric column over the rows whose key column equals a value (a code for strings)
+	double SumWhere(int column, int keycolumn, long long value) const
+	{
+		double sum = 0;
+		if (column < 0 || column >= Traits::Columns) return sum;
+		for (size_t b = 0; b < index.size(); b++)
+		{
+			size_t n = ReadBlock(column, b, values);
+			if (ReadBlock(keycolumn, b, keys) != n) continue;
+			if (types[column] == COLUMN_FLOAT64) sum += ScanSumWhere(&values[0].d, &keys[0].i, n, value);
+			else sum += (double)ScanSumWhere(&values[0].i, &keys[0].i, n, value);
+		}
+		return sum;
+	}
+};
+
+#endif // !COLUMNARSTORE_HPP
@@ -0,0 +1,477 @@
+/*
+* compressedstore.hpp
+* Block-compressed historical data files, compressed on a background thread
+* Author: Tengxiao Fan
+*/
+
+#ifndef COMPRESSEDSTORE_HPP
+#define COMPRESSEDSTORE_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include "functionalities.hpp"
+#include "columnarstore.hpp"
+#include "journal.hpp"
+
+using namespace std;
+
+// Append an unsigned LEB128 varint
+void PutVarint(vector<char>& out, unsigned long long value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back((char)(value | 0x80));
+		value >>= 7;
+	}
+	out.push_back((char)value);
+}
+
+// Read an unsigned LEB128 varint, returns false past the end
+bool GetVarint(const char*& p, const char* end, unsigned long long& value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && p < end; shift += 7)
+	{
+		unsigned char b = (unsigned char)*p++;
+		value |= (unsigned long long)(b & 0x7F) << shift;
+		if (b < 0x80) return true;
+	}
+	return false;
+}
+
+// Map a signed value to an unsigned one, small magnitudes to small values
+unsigned long long ZigZag(long long value)
+{
+	return ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63);
+}
+
+// Inverse of ZigZag
+long long UnZigZag(unsigned long long value)
+{
+	return (long long)(value >> 1) ^ -(long long)(value & 1);
+}
+
+/*
+* Block codec of the compressed files.
+* A block holds rows of the columns of a data type. Each column is encoded on its own:
+* integers and string codes as the zigzag varint of their delta to the previous row,
+* doubles as the delta of their price ticks when all of the block is on the tick grid,
+* or else as the XOR of their bits with the previous row. Repeated deltas are run-length
+* coded (the delta, then the number of repeats), so constant columns take a few bytes.
+* The strings added to the dictionary since the previous block lead the block.
+*/
+class BlockCodec
+{
+public:
+	// Encode rows (row-major cells) and new strings into a payload
+	static void Encode(const ColumnCell* cells, size_t rows, const ColumnSpec* columns, int ncolumns, const vector<string>& strings, vector<char>& out)
+	{
+		PutVarint(out, strings.size());
+		for (auto s = strings.begin(); s != strings.end(); s++)
+		{
+			PutVarint(out, s->size());
+			out.insert(out.end(), s->begin(), s->end());
+		}
+		vector<unsigned long long> deltas(rows);
+		for (int c = 0; c < ncolumns; c++)
+		{
+			bool ticks = true;
+			if (columns[c].type == COLUMN_FLOAT64)
+			{
+				for (size_t r = 0; r < rows && ticks; r++)
+				{
+					double v = cells[r * ncolumns + c].d;
+					ticks = fabs(v) < 1e9 && TicksToPrice(PriceToTicks(v)) == v;
+				}
+				out.push_back(ticks ? 0 : 1);
+			}
+			long long previous = 0;
+			for (size_t r = 0; r < rows; r++)
+			{
+				const ColumnCell& cell = cells[r * ncolumns + c];
+				if (columns[c].type != COLUMN_FLOAT64)
+				{
+					deltas[r] = ZigZag((long long)((unsigned long long)cell.i - (unsigned long long)previous));
+					previous = cell.i;
+				}
+				else if (ticks)
+				{
+					long long t = PriceToTicks(cell.d);
+					deltas[r] = ZigZag(t - previous);
+					previous = t;
+				}
+				else
+				{
+					deltas[r] = (unsigned long long)(cell.i ^ previous);
+					previous = cell.i;
+				}
+			}
+			for (size_t r = 0; r < rows;)
+			{
+				size_t run = 1;
+				while (r + run < rows && deltas[r + run] == deltas[r]) run++;
+				PutVarint(out, deltas[r]);
+				PutVarint(out, run - 1);
+				r += run;
+			}
+		}
+	}
+
+	// Decode a payload into rows (row-major cells) and the strings it adds, returns false if it is corrupt
+	static bool Decode(const char* p, const char* end, size_t rows, const ColumnSpec* columns, int ncolumns, vector<string>& strings, vector<ColumnCell>& cells)
+	{
+		unsigned long long count, size;
+		if (!GetVarint(p, end, count)) return false;
+		for (unsigned long long i = 0; i < count; i++)
+		{
+			if (!GetVarint(p, end, size) || (unsigned long long)(end - p) < size) return false;
+			strings.push_back(string(p, size));
+			p += size;
+		}
+		cells.resize(rows * ncolumns);
+		for (int c = 0; c < ncolumns; c++)
+		{
+			bool ticks = true;
+			if (columns[c].type == COLUMN_FLOAT64)
+			{
+				if (p >= end) return false;
+				ticks = *p++ == 0;
+			}
+			long long previous = 0;
+			for (size_t r = 0; r < rows;)
+			{
+				unsigned long long delta, repeats;
+				if (!GetVarint(p, end, delta) || !GetVarint(p, end, repeats) || repeats >= rows - r) return false;
+				for (unsigned long long k = 0; k <= repeats; k++, r++)
+				{
+					ColumnCell& cell = cells[r * ncolumns + c];
+					if (columns[c].type != COLUMN_FLOAT64)
+					{
+						previous = (long long)((unsigned long long)previous + (unsigned long long)UnZigZag(delta));
+						cell.i = previous;
+					}
+					else if (ticks)
+					{
+						previous += UnZigZag(delta);
+						cell.d = TicksToPrice(previous);
+					}
+					else
+					{
+						previous ^= (long long)delta;
+						cell.i = previous;
+					}
+				}
+			}
+		}
+		return p == end;
+	}
+};
+
+// Header of a compressed block
+struct CompressedBlockHeader
+{
+	unsigned int magic;
+	unsigned int rows;
+	unsigned int size;
+	unsigned int crc;
+};
+const unsigned int CompressedMagic = 0x4B4C4243;
+
+/*
+* Writer of a compressed file of a data type (one with ColumnarTraits).
+* Rows are buffered in blocks; a full block is queued to a background thread which encodes
+* and writes it, so the pipeline only copies cells. The pipeline waits only if the queue is full.
+*/
+template<typename V>
+class CompressedWriter
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	struct Block
+	{
+		vector<ColumnCell> cells;
+		size_t rows;
+		vector<string> strings;
+	};
+
+	int fd;
+	size_t rowsperblock;
+	size_t queuesize;
+	Block* filling;
+	deque<Block*> queue;
+	vector<Block*> freeblocks;
+	bool working;
+	bool stop;
+	mutex lock;
+	condition_variable signal;
+	thread compressor;
+	unordered_map<string, long long> codes;
+	unsigned long long rowcount;
+	unsigned long long bytes;
+	double cputime;
+
+	// Get a block to fill, called with the lock held
+	Block* NewBlock()
+	{
+		if (!freeblocks.empty())
+		{
+			Block* block = freeblocks.back();
+			freeblocks.pop_back();
+			return block;
+		}
+		Block* block = new Block();
+		block->cells.resize(rowsperblock * Traits::Columns);
+		return block;
+	}
+
+	// Queue the filling block, waiting while the queue is full
+	void Submit()
+	{
+		unique_lock<mutex> guard(lock);
+		signal.wait(guard, [this] { return queue.size() < queuesize; });
+		queue.push_back(filling);
+		filling = NewBlock();
+		filling->rows = 0;
+		filling->strings.clear();
+		signal.notify_all();
+	}
+
+	// Encode and write a block, returns the bytes written
+	size_t Write(Block* block, vector<char>& payload)
+	{
+		payload.resize(sizeof(CompressedBlockHeader));
+		BlockCodec::Encode(block->cells.data(), block->rows, Traits::GetColumns(), Traits::Columns, block->strings, payload);
+		CompressedBlockHeader header;
+		header.magic = CompressedMagic;
+		header.rows = (unsigned int)block->rows;
+		header.size = (unsigned int)(payload.size() - sizeof(header));
+		header.crc = Crc32(payload.data() + sizeof(header), header.size);
+		memcpy(payload.data(), &header, sizeof(header));
+		size_t done = 0;
+		while (done < payload.size())
+		{
+			ssize_t n = write(fd, payload.data() + done, payload.size() - done);
+			if (n <= 0) break;
+			done += n;
+		}
+		return done;
+	}
+
+	// Background loop compressing the queued blocks
+	void Run()
+	{
+		vector<char> payload;
+		unique_lock<mutex> guard(lock);
+		while (true)
+		{
+			signal.wait(guard, [this] { return !queue.empty() || stop; });
+			if (queue.empty()) return;
+			Block* block = queue.front();
+			queue.pop_front();
+			working = true;
+			guard.unlock();
+			timespec start, end;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+			size_t written = Write(block, payload);
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+			guard.lock();
+			bytes += written;
+			cputime += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+			freeblocks.push_back(block);
+			working = false;
+			signal.notify_all();
+		}
+	}
+
+public:
+	//Ctor and Dtor
+	CompressedWriter(const string& filename, size_t blockrows = 4096, size_t queue = 4)
+	{
+		rowsperblock = blockrows > 0 ? blockrows : 1;
+		queuesize = queue > 0 ? queue : 1;
+		rowcount = 0;
+		bytes = 0;
+		cputime = 0;
+		working = false;
+		stop = false;
+		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		filling = NewBlock();
+		filling->rows = 0;
+		compressor = thread(&CompressedWriter::Run, this);
+	}
+	~CompressedWriter()
+	{
+		Flush();
+		{
+			lock_guard<mutex> guard(lock);
+			stop = true;
+		}
+		signal.notify_all();
+		compressor.join();
+		delete filling;
+		for (auto b = freeblocks.begin(); b != freeblocks.end(); b++) delete *b;
+		if (fd >= 0) close(fd);
+	}
+	CompressedWriter(const CompressedWriter&) = delete;
+	CompressedWriter& operator=(const CompressedWriter&) = delete;
+
+	// Is the file open
+	bool IsOpen() const
+	{
+		return fd >= 0 && Traits::Columns > 0;
+	}
+
+	// Get the code of a string, adding it to the dictionary if it is new
+	long long Code(const string& s)
+	{
+		auto it = codes.find(s);
+		if (it != codes.end()) return it->second;
+		long long code = (long long)codes.size();
+		codes[s] = code;
+		filling->strings.push_back(s);
+		return code;
+	}
+
+	// Append a row, one cell per column
+	void AppendRow(const ColumnCell* row)
+	{
+		memcpy(&filling->cells[filling->rows * Traits::Columns], row, Traits::Columns * sizeof(ColumnCell));
+		filling->rows++;
+		rowcount++;
+		if (filling->rows == rowsperblock) Submit();
+	}
+
+	// Append the rows of a value, stamped now
+	void Append(const V& data)
+	{
+		Traits::Write(*this, ColumnarTimestamp(), data);
+	}
+
+	// Queue the partial block and wait until every queued block is written
+	void Flush()
+	{
+		if (filling->rows > 0 || !filling->strings.empty()) Submit();
+		unique_lock<mutex> guard(lock);
+		signal.wait(guard, [this] { return queue.empty() && !working; });
+	}
+
+	// Get the number of rows appended
+	unsigned long long GetRowCount() const
+	{
+		return rowcount;
+	}
+
+	// Get the number of bytes written so far
+	unsigned long long GetBytes()
+	{
+		lock_guard<mutex> guard(lock);
+		return bytes;
+	}
+
+	// Get the CPU seconds spent by the background thread so far
+	double GetCpuTime()
+	{
+		lock_guard<mutex> guard(lock);
+		return cputime;
+	}
+};
+
+/*
+* Reader of a compressed file, decoding it a block at a time and returning rows in order.
+*/
+template<typename V>
+class CompressedReader
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	int fd;
+	vector<char> payload;
+	vector<ColumnCell> cells;
+	vector<string> strings;
+	size_t rows;
+	size_t next;
+	bool ok;
+
+	// Read and decode the next block, returns false at the end or on a corrupt block
+	bool ReadBlock()
+	{
+		CompressedBlockHeader header;
+		if (fd < 0 || read(fd, &header, sizeof(header)) != (ssize_t)sizeof(header)) return false;
+		if (header.magic != CompressedMagic)
+		{
+			ok = false;
+			return false;
+		}
+		payload.resize(header.size);
+		size_t done = 0;
+		while (done < payload.size())
+		{
+			ssize_t n = read(fd, payload.data() + done, payload.size() - done);
+			if (n <= 0) break;
+			done += n;
+		}
+		if (done != payload.size() || Crc32(payload.data(), payload.size()) != header.crc ||
+			!BlockCodec::Decode(payload.data(), payload.data() + payload.size(), header.rows, Traits::GetColumns(), Traits::Columns, strings, cells))
+		{
+			ok = false;
+			return false;
+		}
+		rows = header.rows;
+		next = 0;
+		return true;
+	}
+
+public:
+	//Ctor and Dtor
+	CompressedReader(const string& filename)
+	{
+		fd = open(filename.c_str(), O_RDONLY);
+		rows = 0;
+		next = 0;
+		ok = fd >= 0;
+	}
+	~CompressedReader()
+	{
+		if (fd >= 0) close(fd);
+	}
+	CompressedReader(const CompressedReader&) = delete;
+	CompressedReader& operator=(const CompressedReader&) = delete;
+
+	// Has the file been read without error so far
+	bool IsOk() const
+	{
+		return ok;
+	}
+
+	// Read the next row into row (one cell per column), returns false at the end
+	bool Next(ColumnCell* row)
+	{
+		while (next == rows)
+		{
+			if (!ReadBlock()) return false;
+		}
+		memcpy(row, &cells[next * Traits::Columns], Traits::Columns * sizeof(ColumnCell));
+		next++;
+		return true;
+	}
+
+	// Get the string of a code
+	const string& GetString(long long code) const
+	{
+		return strings[code];
+	}
+};
+
+#endif // !COMPRESSEDSTORE_HPP
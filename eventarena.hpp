@@ -0,0 +1,123 @@
+/*
+* eventarena.hpp
+* Monotonic memory arena for the short-lived objects of events, released after each batch of events
+* Author: Tengxiao Fan
+*/
+
+#ifndef EVENTARENA_HPP
+#define EVENTARENA_HPP
+
+#include <memory_resource>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/*
+* Memory resource for the transient objects of events (the fields of the lines read):
+* allocations bump a pointer in a buffer owned by the arena and deallocations do nothing.
+* Connectors call EndEvent once an event is dispatched, and the arena is released every batch
+* events, so the buffer is reused. Allocations beyond the buffer in a batch go to the upstream
+* resource until the release. Objects allocated in the arena must not outlive the batch.
+*/
+class EventArena : public pmr::memory_resource
+{
+private:
+	vector<char> buffer;
+	pmr::monotonic_buffer_resource resource;
+	size_t batch;
+	size_t events;
+
+	void* do_allocate(size_t bytes, size_t alignment) override
+	{
+		return resource.allocate(bytes, alignment);
+	}
+
+	void do_deallocate(void*, size_t, size_t) override {}
+
+	bool do_is_equal(const pmr::memory_resource& other) const noexcept override
+	{
+		return this == &other;
+	}
+
+public:
+	//Ctor and Dtor
+	EventArena(size_t size = 1 << 16, size_t b = 1, pmr::memory_resource* upstream = pmr::new_delete_resource()) :
+		buffer(size), resource(buffer.data(), buffer.size(), upstream)
+	{
+		batch = b < 1 ? 1 : b;
+		events = 0;
+	}
+	~EventArena() = default;
+	EventArena(const EventArena&) = delete;
+	EventArena& operator=(const EventArena&) = delete;
+
+	// An event is done with its transient objects, release them all at the end of a batch
+	void EndEvent()
+	{
+		if (++events >= batch) Release();
+	}
+
+	// Release all objects of the arena
+	void Release()
+	{
+		resource.release();
+		events = 0;
+	}
+
+	// Get the number of events per batch
+	size_t GetBatch() const
+	{
+		return batch;
+	}
+};
+
+/*
+* Scope of an event in an arena, declared before the transient objects of the event:
+* it ends the event after they are destroyed. A null arena is ignored.
+*/
+class EventScope
+{
+private:
+	EventArena* arena;
+
+public:
+	//Ctor and Dtor
+	EventScope(EventArena* a)
+	{
+		arena = a;
+	}
+	~EventScope()
+	{
+		if (arena != nullptr) arena->EndEvent();
+	}
+	EventScope(const EventScope&) = delete;
+	EventScope& operator=(const EventScope&) = delete;
+};
+
+// Get the memory resource of an arena, the default resource (global heap) if it is null
+pmr::memory_resource* ArenaResource(EventArena* arena)
+{
+	return arena != nullptr ? arena : pmr::get_default_resource();
+}
+
+// Stable sort of a range without a temporary buffer: by insertion for the few levels of a book,
+// std::stable_sort beyond them
+template<typename It, typename Less>
+void StableSortSmall(It first, It last, Less less)
+{
+	if (last - first > 32)
+	{
+		stable_sort(first, last, less);
+		return;
+	}
+	for (It i = first; i != last; i++)
+	{
+		auto value = *i;
+		It j = i;
+		for (; j != first && less(value, *(j - 1)); j--) *j = *(j - 1);
+		*j = value;
+	}
+}
+
+#endif // !EVENTARENA_HPP
@@ -11,147 +11,129 @@
 #include "soa.hpp"
 #include "marketdataservice.hpp"
 #include "algoexecutionservice.hpp"
+#include "timerwheel.hpp"
+#include "orderstore.hpp"
 
-//enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
+// Slicing schedules for parent orders
+enum ScheduleType { TWAP, VWAP };
 
 //enum Market { BROKERTEC, ESPEED, CME };
 
 
 
 /**
- * An execution order that can be placed on an exchange.
+ * A fill of an execution order at the venue.
  * Type T is the product type.
  */
- /*
 template<typename T>
-class ExecutionOrder
+class Fill
 {
 
 public:
 
-  // ctor for an order
-  ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+  // ctor for a fill
+	Fill() {}
+	Fill(const T& _product, PricingSide _side, unsigned long long _fillId, unsigned long long _orderId, double _price, long _quantity, long _leavesQuantity) :
+		product(_product), side(_side), fillId(_fillId), orderId(_orderId), price(_price), quantity(_quantity), leavesQuantity(_leavesQuantity) {}
 
   // Get the product
-  const T& GetProduct() const;
+	const T& GetProduct() const
+	{
+		return product;
+	}
 
-  // Get the order ID
-  const string& GetOrderId() const;
+  // Get the side of the order that was filled
+	PricingSide GetPricingSide() const
+	{
+		return side;
+	}
 
-  // Get the order type on this order
-  OrderType GetOrderType() const;
+  // Get the fill ID as text
+	string GetFillId() const
+	{
+		return IdToString(fillId);
+	}
 
-  // Get the price on this order
-  double GetPrice() const;
+  // Get the fill ID
+	unsigned long long GetFillNumber() const
+	{
+		return fillId;
+	}
 
-  // Get the visible quantity on this order
-  long GetVisibleQuantity() const;
+  // Get the ID of the order that was filled
+	unsigned long long GetOrderNumber() const
+	{
+		return orderId;
+	}
 
-  // Get the hidden quantity
-  long GetHiddenQuantity() const;
+  // Get the fill price
+	double GetPrice() const
+	{
+		return price;
+	}
 
-  // Get the parent order ID
-  const string& GetParentOrderId() const;
+  // Get the filled quantity
+	long GetQuantity() const
+	{
+		return quantity;
+	}
 
-  // Is child order?
-  bool IsChildOrder() const;
+  // Get the quantity of the order left after this fill
+	long GetLeavesQuantity() const
+	{
+		return leavesQuantity;
+	}
 
 private:
   T product;
   PricingSide side;
-  string orderId;
-  OrderType orderType;
+  unsigned long long fillId;
+  unsigned long long orderId;
   double price;
-  double visibleQuantity;
-  double hiddenQuantity;
-  string parentOrderId;
-  bool isChildOrder;
+  long quantity;
+  long leavesQuantity;
 
 };
-*/
+
+template<typename T>
+class ExecutionAlgoExecutionListener;
+template<typename T>
+class ExecutionVenueListener;
 
 /**
  * Service for executing orders on an exchange.
  * Keyed on product identifier.
  * Type T is the product type.
  */
-
-/*
-template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T &_product, PricingSide _side, string _orderId, OrderType _orderType, double _price, double _visibleQuantity, double _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
-  product(_product)
-{
-  side = _side;
-  orderId = _orderId;
-  orderType = _orderType;
-  price = _price;
-  visibleQuantity = _visibleQuantity;
-  hiddenQuantity = _hiddenQuantity;
-  parentOrderId = _parentOrderId;
-  isChildOrder = _isChildOrder;
-}
-
-template<typename T>
-const T& ExecutionOrder<T>::GetProduct() const
-{
-  return product;
-}
-
-template<typename T>
-const string& ExecutionOrder<T>::GetOrderId() const
-{
-  return orderId;
-}
-
-template<typename T>
-OrderType ExecutionOrder<T>::GetOrderType() const
-{
-  return orderType;
-}
-
-template<typename T>
-double ExecutionOrder<T>::GetPrice() const
-{
-  return price;
-}
-
-template<typename T>
-long ExecutionOrder<T>::GetVisibleQuantity() const
-{
-  return visibleQuantity;
-}
-
-template<typename T>
-long ExecutionOrder<T>::GetHiddenQuantity() const
-{
-  return hiddenQuantity;
-}
-
-template<typename T>
-const string& ExecutionOrder<T>::GetParentOrderId() const
-{
-  return parentOrderId;
-}
-
-template<typename T>
-bool ExecutionOrder<T>::IsChildOrder() const
-{
-  return isChildOrder;
-}
-*/
-
-template<typename T>
-class ExecutionAlgoExecutionListener;
-
 template<typename T>
 class ExecutionService : public Service<string, ExecutionOrder <T> >
 {
 
 private:
+	//A parent order being sliced into child orders
+	struct ParentOrder
+	{
+		ExecutionOrder<T> order;
+		long remaining;
+		int slice;
+	};
+
 	map<string, ExecutionOrder<T>> executionordermap;
 	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
 	ExecutionAlgoExecutionListener<T>* AlgoExecutionListener;
-
+	ExecutionVenueListener<T>* VenueListener;
+	OrderStore orderstore;
+
+	//Parent orders pooled by slot, the slot is the payload of their timer
+	vector<ParentOrder> parentorders;
+	vector<int> freeparents;
+	TimerWheel timers;
+	ScheduleType scheduletype;
+	long slicethreshold;
+	int slices;
+	long sliceinterval;
+	vector<double> volumeprofile;
+	vector<double> sliceweights;
 
 public:
 	//Ctor and Dtor
@@ -160,6 +142,11 @@ public:
 		executionordermap = map<string, ExecutionOrder<T>>();
 		listeners= vector<ServiceListener<ExecutionOrder<T>>*>();
 		AlgoExecutionListener = new ExecutionAlgoExecutionListener<T>(this);
+		VenueListener = new ExecutionVenueListener<T>(this);
+		scheduletype = TWAP;
+		slicethreshold = 0;
+		slices = 1;
+		sliceinterval = 1;
 	}
 	~ExecutionService() = default;
 
@@ -174,6 +161,7 @@ public:
 	{
 		string key = data.GetProduct().GetProductId();
 		executionordermap[key] = data;
+		orderstore.Add(data.GetOrderNumber(), key, data.GetPricingSide(), data.GetOrderType(), data.GetPrice(), data.GetQuantity());
 		//Call all the listeners
 		for (auto i = listeners.begin(); i != listeners.end(); i++)
 		{
@@ -199,14 +187,177 @@ public:
 		return AlgoExecutionListener;
 	}
 
+	// Get the listener to the venue fills
+	ExecutionVenueListener<T>* GetVenueListener()
+	{
+		return VenueListener;
+	}
+
+	// Get the store of open orders
+	const OrderStore& GetOrderStore() const
+	{
+		return orderstore;
+	}
+
+	// Apply a venue fill to its order
+	void OnFill(const Fill<T>& fill)
+	{
+		orderstore.Fill(fill.GetOrderNumber(), fill.GetQuantity());
+	}
+
+	// The venue cancelled the remainder of an order
+	void OnCancel(const Fill<T>& fill)
+	{
+		orderstore.Cancel(fill.GetOrderNumber());
+	}
+
+	// Cancel an open order, listeners get a remove event with its open quantity
+	bool CancelOrder(unsigned long long orderId)
+	{
+		const OrderRecord* record = orderstore.Find(orderId);
+		if (record == nullptr) return false;
+		ExecutionOrder<T> order = MakeOrder(*record, record->price, record->quantity - record->filled);
+		orderstore.Cancel(orderId);
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessRemove(order);
+		}
+		return true;
+	}
+
+	// Amend the price and total quantity of an open order, listeners get an update event with its open quantity
+	// An order amended down to its filled quantity is cancelled: listeners get a remove event as with CancelOrder
+	bool AmendOrder(unsigned long long orderId, double price, long quantity)
+	{
+		const OrderRecord* record = orderstore.Find(orderId);
+		if (record == nullptr) return false;
+		if (quantity <= record->filled) return CancelOrder(orderId);
+		ExecutionOrder<T> order = MakeOrder(*record, price, quantity - record->filled);
+		orderstore.Amend(orderId, price, quantity);
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessUpdate(order);
+		}
+		return true;
+	}
+
 	// Execute an order on a market
+	// Each order is one tick of the scheduling clock; orders above the slicing threshold are sliced
 	void ExecuteOrder(ExecutionOrder<T>& order)
 	{
 		//std::cout << order.GetPrice() <<","<< order.GetQuantity() <<","<< order.GetPricingSide() << endl;
-		
-		OnMessage(order);
+		AdvanceTime(timers.GetTime());
+		if (slicethreshold > 0 && order.GetQuantity() > slicethreshold)
+		{
+			SliceOrder(order);
+		}
+		else
+		{
+			OnMessage(order);
+		}
+	}
+
+	// Slice orders larger than threshold (0 to disable) into child orders every interval ticks
+	void SetSlicing(ScheduleType type, long threshold, int n, long interval)
+	{
+		scheduletype = type;
+		slicethreshold = threshold;
+		slices = max(1, n);
+		sliceinterval = max(1L, interval);
+		BuildSliceWeights();
+	}
+
+	// Set the intraday volume profile that VWAP slices follow
+	void SetVolumeProfile(const vector<double>& profile)
+	{
+		volumeprofile = profile;
+		BuildSliceWeights();
+	}
+
+	// Slice a parent order, its first child goes out on the next tick
+	void SliceOrder(const ExecutionOrder<T>& order)
+	{
+		int slot;
+		if (!freeparents.empty())
+		{
+			slot = freeparents.back();
+			freeparents.pop_back();
+		}
+		else
+		{
+			slot = (int)parentorders.size();
+			parentorders.push_back(ParentOrder());
+		}
+		if (sliceweights.empty()) BuildSliceWeights();
+		parentorders[slot].order = order;
+		parentorders[slot].remaining = order.GetQuantity();
+		parentorders[slot].slice = 0;
+		timers.Schedule(timers.GetTime(), slot);
+	}
+
+	// Advance the scheduling clock to tick t, sending out the child orders that are due
+	void AdvanceTime(unsigned long long t)
+	{
+		timers.Advance(t, [this](unsigned long long slot) { SendChildOrder((int)slot); });
+	}
+
+	// Get the current tick of the scheduling clock
+	unsigned long long GetTime() const
+	{
+		return timers.GetTime();
+	}
+
+	// Get the number of parent orders still being sliced
+	long GetActiveParentOrders() const
+	{
+		return timers.GetCount();
+	}
+
+private:
+	// Rebuild an order from its record
+	ExecutionOrder<T> MakeOrder(const OrderRecord& record, double price, long quantity)
+	{
+		const T& product = executionordermap[orderstore.GetProductId(record.product)].GetProduct();
+		return ExecutionOrder<T>(product, record.side, record.orderId, record.type, price, quantity, 0, false);
 	}
 
+	// Weight of each slice: equal for TWAP, following the volume profile for VWAP
+	void BuildSliceWeights()
+	{
+		sliceweights = vector<double>(slices, 1.0 / slices);
+		if (scheduletype != VWAP || volumeprofile.empty()) return;
+		double total = 0;
+		for (int i = 0; i < slices; i++)
+		{
+			sliceweights[i] = volumeprofile[i * volumeprofile.size() / slices];
+			total += sliceweights[i];
+		}
+		for (int i = 0; i < slices && total > 0; i++)
+		{
+			sliceweights[i] /= total;
+		}
+	}
+
+	// Send the next child order of a parent and schedule the one after
+	void SendChildOrder(int slot)
+	{
+		ParentOrder& parent = parentorders[slot];
+		const ExecutionOrder<T>& o = parent.order;
+		long quantity = parent.remaining;
+		if (parent.slice < slices - 1)
+		{
+			quantity = min(parent.remaining, (long)llround(o.GetQuantity() * sliceweights[parent.slice]));
+		}
+		parent.remaining -= quantity;
+		parent.slice++;
+		bool done = parent.remaining <= 0 || parent.slice >= slices;
+		ExecutionOrder<T> child(o.GetProduct(), o.GetPricingSide(), IdGenerator::NextId(), o.GetOrderType(), o.GetPrice(), quantity, o.GetOrderNumber(), true);
+
+		//The timer fired on the previous tick
+		if (done) freeparents.push_back(slot);
+		else timers.Schedule(timers.GetTime() - 1 + sliceinterval, slot);
+		if (quantity > 0) OnMessage(child);
+	}
 };
 
 template <typename T>
@@ -239,4 +390,39 @@ public:
 	void ProcessUpdate(AlgoExecution<T>& _data) {}
 };
 
+/*
+* Execution listener to the venue: fills and cancelled remainders update the open orders
+*/
+template <typename T>
+class ExecutionVenueListener : public ServiceListener<Fill<T>>
+{
+private:
+
+	ExecutionService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	ExecutionVenueListener(ExecutionService<T>* s)
+	{
+		service = s;
+	}
+	~ExecutionVenueListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Fill<T>& data)
+	{
+		service->OnFill(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Fill<T>& data)
+	{
+		service->OnCancel(data);
+	}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Fill<T>& data) {}
+};
+
 #endif
@@ -7,13 +7,19 @@
 #ifndef Functionalities_HPP
 #define Functionalities_HPP
 #include <string>
+#include <string_view>
 #include<random>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <cmath>
+#include <unordered_map>
 #include "soa.hpp"
 #include "products.hpp"
 
 
 //This turns a fractional price into a double price
-double FractionaltoPrice(string s)
+double FractionaltoPrice(string_view s)
 {
 	string part1="";
 	string part2="";
@@ -86,6 +92,8 @@ Bond MakeBond(string cusip)
 		bond = Bond(cusip, CUSIP, "T", 0.04500, from_string("2033/12/31"));
 	else if (cusip == "TMUBMUSD20Y") 
 		bond = Bond(cusip, CUSIP, "T", 0.04750, from_string("2043/12/31"));
+	else if (cusip == "TMUBMUSD30Y")
+		bond = Bond(cusip, CUSIP, "T", 0.04750, from_string("2053/12/31"));
 	return bond;
 }
 
@@ -107,20 +115,219 @@ double CaluculatePV01(string cusip)
 		pv01 = 0.1;
 	else if (cusip == "TMUBMUSD20Y")
 		pv01 = 0.2;
+	else if (cusip == "TMUBMUSD30Y")
+		pv01 = 0.3;
 	return pv01;
 }
 
-// Generate random IDs.
+/*
+* Get the tenor (in years) of the bonds
+*/
+double GetTenor(string cusip)
+{
+	double tenor = 0;
+	if (cusip == "TMUBMUSD02Y")
+		tenor = 2;
+	else if (cusip == "TMUBMUSD03Y")
+		tenor = 3;
+	else if (cusip == "TMUBMUSD05Y")
+		tenor = 5;
+	else if (cusip == "TMUBMUSD07Y")
+		tenor = 7;
+	else if (cusip == "TMUBMUSD10Y")
+		tenor = 10;
+	else if (cusip == "TMUBMUSD20Y")
+		tenor = 20;
+	else if (cusip == "TMUBMUSD30Y")
+		tenor = 30;
+	return tenor;
+}
+
+/*
+* Lock-free generator of unique 64-bit ids.
+* Each thread reserves a block of ids from a shared atomic counter and hands them out
+* from the block, so the counter is only touched once per block.
+* Reserve moves the counter past ids already in use (e.g. recovered from a journal);
+* threads then drop the rest of their blocks and take new ones.
+*/
+class IdGenerator
+{
+public:
+	//Number of ids reserved by a thread at a time
+	static const unsigned long long BlockSize = 4096;
+
+	//Get the next id of the calling thread
+	static unsigned long long NextId()
+	{
+		thread_local unsigned long long next = 0;
+		thread_local unsigned long long end = 0;
+		thread_local unsigned long long epoch = 0;
+		if (next == end || epoch != Epoch().load())
+		{
+			epoch = Epoch().load();
+			next = Counter().fetch_add(BlockSize);
+			end = next + BlockSize;
+		}
+		return next++;
+	}
+
+	// Make every id handed out from now on greater than minId
+	static void Reserve(unsigned long long minId)
+	{
+		unsigned long long current = Counter().load();
+		while (current <= minId && !Counter().compare_exchange_weak(current, minId + 1)) {}
+		Epoch().fetch_add(1);
+	}
+
+private:
+	static atomic<unsigned long long>& Counter()
+	{
+		static atomic<unsigned long long> counter(1);
+		return counter;
+	}
+
+	//Changed by Reserve, so that threads drop the blocks they hold
+	static atomic<unsigned long long>& Epoch()
+	{
+		static atomic<unsigned long long> epoch(0);
+		return epoch;
+	}
+};
+
+//Width of the text form of an id: 13 base-36 digits cover 64 bits
+const int IdWidth = 13;
+
+// Write an id as fixed width base-36 text into buf (IdWidth chars, not terminated)
+int WriteId(unsigned long long id, char* buf)
+{
+	static const char digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+	for (int i = IdWidth - 1; i >= 0; i--)
+	{
+		buf[i] = digits[id % 36];
+		id /= 36;
+	}
+	return IdWidth;
+}
+
+// Get the text form of an id
+string IdToString(unsigned long long id)
+{
+	char buf[IdWidth];
+	return string(buf, WriteId(id, buf));
+}
+
+// Read an id back from its text form, false if the text is not an id written by WriteId
+bool StringToId(string_view s, unsigned long long& id)
+{
+	if (s.size() != IdWidth) return false;
+	id = 0;
+	for (auto i = s.begin(); i != s.end(); i++)
+	{
+		unsigned long long d;
+		if (*i >= '0' && *i <= '9') d = *i - '0';
+		else if (*i >= 'A' && *i <= 'Z') d = *i - 'A' + 10;
+		else return false;
+		if (id > (~0ULL - d) / 36) return false;
+		id = id * 36 + d;
+	}
+	return true;
+}
+
+// Generate unique IDs.
 string GenerateId()
 {
-	string base = "1234567890ABCDEFGHIJKLMNOPQRSTUVWXYZ";
-	string id = "";
-	for (int i=0;i<9;i++)
+	return IdToString(IdGenerator::NextId());
+}
+
+//Prices are held as integer ticks of 2^-20: exact for 1/256 and finer binary fractions
+const double PriceTick = 1.0 / 1048576.0;
+
+// Convert a price to ticks
+long long PriceToTicks(double price)
+{
+	return llround(price / PriceTick);
+}
+
+// Convert ticks to a price
+double TicksToPrice(long long ticks)
+{
+	return ticks * PriceTick;
+}
+
+/*
+* Process-wide table interning values by a string key, so that records can
+* hold a small index instead of a copy. Entries are never removed and keep
+* their address. Index -1 stands for a default value.
+* It is safe to use from several threads: Intern and Find take a lock, while Get reads without
+* one, from blocks of values that never move once published.
+*/
+template<typename V>
+class InternTable
+{
+public:
+	//Values per block, and the most blocks of a table
+	static const int BlockSize = 1024;
+	static const int MaxBlocks = 16384;
+
+	// Get the index of a key, adding the value if the key is new
+	static int Intern(const string& key, const V& value)
+	{
+		Table& table = GetTable();
+		lock_guard<mutex> lock(table.guard);
+		auto it = table.index.find(key);
+		if (it != table.index.end()) return it->second;
+		int i = table.count;
+		if (i / BlockSize >= MaxBlocks) throw length_error("intern table full");
+		if (i % BlockSize == 0) table.blocks[i / BlockSize].store(new V[BlockSize], memory_order_release);
+		table.blocks[i / BlockSize].load(memory_order_relaxed)[i % BlockSize] = value;
+		table.index[key] = i;
+		table.count = i + 1;
+		return i;
+	}
+
+	// Get the index of a key, -1 if it is not interned
+	static int Find(const string& key)
+	{
+		Table& table = GetTable();
+		lock_guard<mutex> lock(table.guard);
+		auto it = table.index.find(key);
+		return it == table.index.end() ? -1 : it->second;
+	}
+
+	// Get the value of an index (one returned by Intern or Find)
+	static const V& Get(int i)
+	{
+		static const V empty = V();
+		return i < 0 ? empty : GetTable().blocks[i / BlockSize].load(memory_order_acquire)[i % BlockSize];
+	}
+
+private:
+	struct Table
 	{
-		int random_num = rand() % (base.size());
-		id.push_back(base[random_num]);
+		mutex guard;
+		unordered_map<string, int> index;
+		atomic<V*> blocks[MaxBlocks] = {};
+		int count = 0;
+
+		~Table()
+		{
+			for (int b = 0; b < MaxBlocks; b++) delete[] blocks[b].load();
+		}
+	};
+
+	static Table& GetTable()
+	{
+		static Table table;
+		return table;
 	}
-	return id;
+};
+
+// Get a product by id: the interned one, or else a new bond
+template<typename T>
+T FindProduct(const string& productId)
+{
+	int product = InternTable<T>::Find(productId);
+	return product >= 0 ? InternTable<T>::Get(product) : MakeBond(productId);
 }
 
 #endif // !Functionalities_HPP
@@ -13,7 +13,16 @@
 #include "positionservice.hpp"
 #include "tradebookingservice.hpp"
 #include "inquiryservice.hpp"
+#include "columnarstore.hpp"
+#include "compressedstore.hpp"
+#include "historyring.hpp"
+#include "asyncwriter.hpp"
 #include <iomanip>
+#include <sstream>
+
+// Policy of persisting the CSV file: every record, only the changed fields of each record,
+// or a conflated snapshot of the latest record of every product at a fixed interval of updates
+enum PersistPolicy { PERSIST_FULL, PERSIST_DELTA, PERSIST_CONFLATED };
 
 template <typename T>
 class HistoricalDataConnector;
@@ -24,6 +33,12 @@ class HistoricalDataListener;
 
 /**
  * Service for processing and persisting historical data to a persistent store.
+ * Data is written as CSV, and for the data types with ColumnarTraits, optionally also to
+ * fixed-width column files (columnar store) or to a block-compressed file, alongside or instead of the CSV.
+ * The CSV file holds every record, or with a PersistPolicy only the changed fields of each record (delta)
+ * or a conflated snapshot of all products at a fixed interval. It is opened for each record, or with the
+ * asynchronous writer enabled kept open and written through io_uring (AsyncFileWriter).
+ * With history enabled, the last rows of each product are also kept in memory (HistoryStore).
  * Keyed on some persistent key.
  * Type T is the data type to persist.
  */
@@ -36,6 +51,7 @@ private:
 	HistoricalDataConnector<T>* connector;
 	HistoricalDataListener<T>* DataListener;
 	string type;
+	HistoryStore<T>* history;
 
 public:
 	//Ctor and Dtor
@@ -46,6 +62,7 @@ public:
 		connector = new HistoricalDataConnector<T>(this);
 		DataListener = new HistoricalDataListener<T>(this);
 		type = "POSITION";
+		history = nullptr;
 	}
 
 	HistoricalDataService(string t)
@@ -55,9 +72,16 @@ public:
 		connector = new HistoricalDataConnector<T>(this);
 		DataListener = new HistoricalDataListener<T>(this);
 		type = t;
+		history = nullptr;
 	}
 
-	~HistoricalDataService() = default;
+	~HistoricalDataService()
+	{
+		delete connector;
+		delete history;
+	}
+	HistoricalDataService(const HistoricalDataService&) = delete;
+	HistoricalDataService& operator=(const HistoricalDataService&) = delete;
 
 
 	// Get data on our service given a key
@@ -71,6 +95,7 @@ public:
 	{
 		string key = data.GetProduct().GetProductId();
 		historicaldatamap[key] = data;
+		if (history != nullptr) history->Append(data);
 		//Notify all the listeners
 		for (auto i = listeners.begin(); i != listeners.end(); i++)
 		{
@@ -111,8 +136,65 @@ public:
   // Persist data to a store
 	void PersistData(string persistKey, T& data)
 	{
+		if (history != nullptr) history->Append(data);
 		connector->Publish(data);
 	}
+
+	// Also write the data to a columnar store, and the CSV file only if csv is set
+	// Returns false if the data type has no columns or the store cannot be opened
+	bool EnableColumnar(const string& base, bool csv = true)
+	{
+		return connector->EnableColumnar(base, csv);
+	}
+
+	// Get the persisted rows (row-major, one cell per column of ColumnarTraits<T>) of a product
+	// with a timestamp in [from, to] from the columnar store; returns their number
+	size_t Query(const string& productId, long long from, long long to, vector<ColumnCell>& rows)
+	{
+		return connector->Query(productId, from, to, rows);
+	}
+
+	// Keep the last capacity rows of each product in memory
+	// Returns false if the data type has no columns
+	bool EnableHistory(size_t capacity)
+	{
+		if (ColumnarTraits<T>::Columns < 2) return false;
+		delete history;
+		history = new HistoryStore<T>(capacity);
+		return true;
+	}
+
+	// Get the in-memory history of a product, nullptr if history is off or it has no rows
+	const HistoryRing<T>* GetHistory(const string& productId) const
+	{
+		return history == nullptr ? nullptr : history->GetRing(productId);
+	}
+
+	// Get the in-memory history of all products, nullptr if history is off
+	const HistoryStore<T>* GetHistoryStore() const
+	{
+		return history;
+	}
+
+	// Set the persistence policy of the CSV file, interval updates between snapshots if conflated
+	void SetPersistPolicy(PersistPolicy policy, unsigned long long interval = 1)
+	{
+		connector->SetPersistPolicy(policy, interval);
+	}
+
+	// Write the CSV file through an asynchronous writer, on io_uring if uring is set and it is available
+	// Returns false if the file cannot be opened
+	bool EnableAsyncWriter(bool uring = true)
+	{
+		return connector->EnableAsyncWriter(uring);
+	}
+
+	// Also write the data to a block-compressed file, and the CSV file only if csv is set
+	// Returns false if the data type has no columns or the file cannot be opened
+	bool EnableCompressed(const string& filename, bool csv = true)
+	{
+		return connector->EnableCompressed(filename, csv);
+	}
 };
 
 /*
@@ -123,53 +205,250 @@ class HistoricalDataConnector :public Connector<T>
 {
 private:
 	HistoricalDataService<T>* service;
+	ColumnarWriter<T>* columnar;
+	string columnarbase;
+	CompressedWriter<T>* compressed;
+	bool csv;
+
+	//Persistence policy of the CSV file, the last record written of each product (delta),
+	//and the latest value of each product with the number of updates not yet written (conflated)
+	PersistPolicy policy;
+	unordered_map<string, string> lastrecords;
+	map<string, T> latest;
+	unsigned long long conflateinterval;
+	unsigned long long pending;
+
+	//Asynchronous writer of the CSV file, nullptr to open the file for each record
+	AsyncFileWriter* asyncwriter;
+	//Buffer of the file stream opened for each record, so opening it does not allocate one
+	vector<char> filebuffer;
+
+	// Get the CSV file of the service type
+	const char* GetFileName() const
+	{
+		string type = service->GetType();
+		if (type == "POSITION") return "positions.txt";
+		if (type == "RISK") return "risk.txt";
+		if (type == "KEYRATE") return "keyraterisk.txt";
+		if (type == "PNL") return "pnl.txt";
+		if (type == "EXECUTION") return "execution.txt";
+		if (type == "STREAMING") return "streaming.txt";
+		if (type == "INQUIRY") return "allinquiries.txt";
+		return "";
+	}
+
+	// Open the CSV file to append to it, in the buffer of the connector
+	void OpenFile(ofstream& file)
+	{
+		file.rdbuf()->pubsetbuf(filebuffer.data(), filebuffer.size());
+		file.open(GetFileName(), ios::app);
+	}
+
+	// Write a record to the CSV file stream, straight into the buffer of the asynchronous writer if it has a serializer
+	void WriteRecord(T& data, ostream& out)
+	{
+		if (SerializerTraits<T>::Defined && asyncwriter != nullptr)
+		{
+			char* buf = asyncwriter->Reserve(SerializerTraits<T>::MaxSize(data));
+			if (buf != nullptr)
+			{
+				asyncwriter->Commit(SerializerTraits<T>::Write(data, buf));
+				return;
+			}
+		}
+		data.Output(out);
+	}
+
+	// Get the CSV line of a record, without its end of line
+	void GetRecord(T& data, string& record)
+	{
+		if (SerializerTraits<T>::Defined)
+		{
+			record.resize(SerializerTraits<T>::MaxSize(data));
+			record.resize(SerializerTraits<T>::Write(data, &record[0]));
+		}
+		else
+		{
+			ostringstream stream;
+			stream << std::fixed << std::setprecision(6);
+			data.Output(stream);
+			record = stream.str();
+		}
+		if (!record.empty() && record.back() == '\n') record.pop_back();
+	}
+
+	// Write the fields of a record that changed since the last record of its product, as
+	// the product and then index=value for each changed field; nothing if no field changed
+	void PublishDelta(T& data)
+	{
+		string record;
+		GetRecord(data, record);
+		string& last = lastrecords[data.GetProduct().GetProductId()];
+
+		string delta;
+		size_t start = 0, laststart = 0;
+		for (int field = 0; start <= record.size(); field++)
+		{
+			size_t end = record.find(',', start);
+			if (end == string::npos) end = record.size();
+			size_t lastend = laststart <= last.size() ? last.find(',', laststart) : string::npos;
+			if (lastend == string::npos) lastend = last.size();
+			bool changed = laststart > last.size() || last.compare(laststart, lastend - laststart, record, start, end - start) != 0;
+			if (field == 0) delta.append(record, start, end - start);
+			else if (changed) delta.append(",").append(to_string(field)).append("=").append(record, start, end - start);
+			start = end + 1;
+			laststart = lastend + 1;
+		}
+		//Skip a record of a known product with no changed field
+		if (delta.find(',') == string::npos && !last.empty()) return;
+		last.swap(record);
+
+		if (asyncwriter != nullptr)
+		{
+			asyncwriter->GetStream() << delta << '\n';
+			return;
+		}
+		ofstream file;
+		OpenFile(file);
+		file << delta << '\n';
+	}
 
 public:
 	//Ctor and Dtor
 	HistoricalDataConnector(HistoricalDataService<T>* s)
 	{
 		service = s;
+		columnar = nullptr;
+		compressed = nullptr;
+		csv = true;
+		policy = PERSIST_FULL;
+		conflateinterval = 1;
+		pending = 0;
+		asyncwriter = nullptr;
+		filebuffer.resize(BUFSIZ);
+	}
+	~HistoricalDataConnector()
+	{
+		WriteConflated();
+		delete asyncwriter;
+		delete columnar;
+		delete compressed;
 	}
-	~HistoricalDataConnector() = default;
 
-	//Publisher
-	void Publish(T& data)
+	// Write to a columnar store with base name base, and to the CSV file only if c is set
+	bool EnableColumnar(const string& base, bool c = true)
 	{
+		if (ColumnarTraits<T>::Columns == 0) return false;
+		delete columnar;
+		columnar = new ColumnarWriter<T>(base);
+		columnarbase = base;
+		if (!columnar->IsOpen())
+		{
+			delete columnar;
+			columnar = nullptr;
+			return false;
+		}
+		csv = c;
+		return true;
+	}
 
-		string type = service->GetType();
+	// Query the columnar store for the rows of a product in a time range, after writing the partial block
+	size_t Query(const string& productId, long long from, long long to, vector<ColumnCell>& rows)
+	{
+		rows.clear();
+		if (columnar == nullptr) return 0;
+		columnar->Flush();
+		ColumnarReader<T> reader(columnarbase);
+		return reader.Query(productId, from, to, rows);
+	}
+
+	// Write to a block-compressed file, and to the CSV file only if c is set
+	bool EnableCompressed(const string& filename, bool c = true)
+	{
+		if (ColumnarTraits<T>::Columns == 0) return false;
+		delete compressed;
+		compressed = new CompressedWriter<T>(filename);
+		if (!compressed->IsOpen())
+		{
+			delete compressed;
+			compressed = nullptr;
+			return false;
+		}
+		csv = c;
+		return true;
+	}
+
+	// Write the CSV file through an asynchronous writer
+	bool EnableAsyncWriter(bool uring = true)
+	{
+		WriteConflated();
+		delete asyncwriter;
+		asyncwriter = new AsyncFileWriter(GetFileName(), uring);
+		if (!asyncwriter->IsOpen())
+		{
+			delete asyncwriter;
+			asyncwriter = nullptr;
+			return false;
+		}
+		asyncwriter->GetStream() << std::fixed << std::setprecision(6);
+		return true;
+	}
+
+	// Set the persistence policy of the CSV file; interval is the number of updates between conflated snapshots
+	void SetPersistPolicy(PersistPolicy p, unsigned long long interval)
+	{
+		WriteConflated();
+		policy = p;
+		conflateinterval = max(1ULL, interval);
+		lastrecords.clear();
+	}
+
+	// Write the conflated snapshot of the updates since the last one
+	void WriteConflated()
+	{
+		if (pending == 0) return;
+		pending = 0;
 		ofstream file;
-		file << std::fixed << std::setprecision(6) << std::endl;
-		if (type == "POSITION")
+		if (asyncwriter == nullptr)
 		{
-			file.open("positions.txt", ios::app);
-			
-			//string trsy1 = "TRSY1";
-			//string trsy2 = "TRSY2";
-			//string trsy3 = "TRSY3";
-			//file << data.GetProduct().GetProductId() << ",TRSY1," << data.GetPosition(trsy1) << ",TRSY2," << data.GetPosition(trsy2) << ",TRSY3," << data.GetPosition(trsy3) << ",TOTAL," << data.GetAggregatePosition() << endl;
+			file << std::fixed << std::setprecision(6);
+			OpenFile(file);
 		}
-		else if (type == "RISK")
+		ostream& out = asyncwriter != nullptr ? asyncwriter->GetStream() : file;
+		for (auto i = latest.begin(); i != latest.end(); i++)
 		{
-			file.open("risk.txt", ios::app);
-			//file << data.GetProduct().GetProductId() << "," << data.GetPV01() << "," << data.GetQuantity() << endl;
+			WriteRecord(i->second, out);
 		}
-		else if (type == "EXECUTION")
+	}
+
+	//Publisher
+	void Publish(T& data)
+	{
+		if (columnar != nullptr) columnar->Append(data);
+		if (compressed != nullptr) compressed->Append(data);
+		if (!csv) return;
+
+		if (policy == PERSIST_DELTA)
 		{
-			file.open("execution.txt", ios::app);
+			PublishDelta(data);
+			return;
 		}
-		else if (type == "STREAMING")
+		if (policy == PERSIST_CONFLATED)
 		{
-			file.open("streaming.txt", ios::app);
-			//cout << "Writing Start" << endl;
-			//file << data.GetProduct().GetProductId() << "," << data.GetBidPrice() << "," << data.GetOfferPrice() << "," << data.GetVisibleQuantity() << "," << data.GetHiddenQuantity()<<endl;
+			latest[data.GetProduct().GetProductId()] = data;
+			if (++pending >= conflateinterval) WriteConflated();
+			return;
 		}
-		else if (type == "INQUIRY")
+
+		if (asyncwriter != nullptr)
 		{
-			file.open("allinquiries.txt", ios::app);
+			WriteRecord(data, asyncwriter->GetStream());
+			return;
 		}
+		ofstream file;
+		file << std::fixed << std::setprecision(6);
+		OpenFile(file);
 		data.Output(file);
-		//file.close();
-		//if (type == "STREAMING") cout << "Writing end" << endl;
 	}
 	//Subscriber
 	void Subscribe(ifstream& data) {}
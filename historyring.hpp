@@ -0,0 +1,250 @@
+/*
+* historyring.hpp
+* In-memory history of the last updates of each product, in ring buffers of columns
+* Author: Tengxiao Fan
+*/
+
+#ifndef HISTORYRING_HPP
+#define HISTORYRING_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "columnarstore.hpp"
+
+using namespace std;
+
+/*
+* Ring buffer of the last rows of a product, one array of cells per column of ColumnarTraits<V>
+* (structure of arrays), so a statistic over a column reads contiguous memory.
+* Columns grow up to the capacity and then the oldest row is overwritten; a column is then
+* two contiguous segments, the older one from the head to the end and the newer one from the start.
+* Timestamps (the first column) are non-decreasing, so a time window is found by binary search.
+*/
+template<typename V>
+class HistoryRing
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	vector<vector<ColumnCell>> columns;
+	size_t capacity;
+	size_t head;
+
+	// Get the position in the columns of the i-th oldest row
+	size_t Slot(size_t i) const
+	{
+		size_t s = head + i;
+		return s >= capacity ? s - capacity : s;
+	}
+
+public:
+	//Ctor and Dtor
+	HistoryRing(size_t c)
+	{
+		columns = vector<vector<ColumnCell>>(Traits::Columns);
+		capacity = max((size_t)1, c);
+		head = 0;
+	}
+	~HistoryRing() = default;
+
+	// Append a row, one cell per column, overwriting the oldest row once full
+	void Push(const ColumnCell* row)
+	{
+		if (columns[0].size() < capacity)
+		{
+			for (int c = 0; c < Traits::Columns; c++) columns[c].push_back(row[c]);
+			return;
+		}
+		for (int c = 0; c < Traits::Columns; c++) columns[c][head] = row[c];
+		head = head + 1 == capacity ? 0 : head + 1;
+	}
+
+	// Get the number of rows held
+	size_t GetCount() const
+	{
+		return columns[0].size();
+	}
+
+	// Get the maximum number of rows held
+	size_t GetCapacity() const
+	{
+		return capacity;
+	}
+
+	// Get a cell of the i-th oldest row
+	ColumnCell Get(int column, size_t i) const
+	{
+		return columns[column][Slot(i)];
+	}
+
+	// Get a cell of the i-th newest row (0 is the latest)
+	ColumnCell GetLatest(int column, size_t i = 0) const
+	{
+		return columns[column][Slot(GetCount() - 1 - i)];
+	}
+
+	// Get the last n rows of a column as two contiguous segments, older one first
+	void GetSegments(int column, size_t n, const ColumnCell*& first, size_t& firstsize, const ColumnCell*& second, size_t& secondsize) const
+	{
+		const vector<ColumnCell>& cells = columns[column];
+		n = min(n, cells.size());
+		size_t start = Slot(cells.size() - n);
+		firstsize = min(n, cells.size() - start);
+		secondsize = n - firstsize;
+		first = cells.data() + start;
+		second = cells.data();
+	}
+
+	// Get the number of the last rows with a timestamp at or after from
+	size_t CountSince(long long from) const
+	{
+		size_t low = 0, high = GetCount();
+		while (low < high)
+		{
+			size_t mid = (low + high) / 2;
+			if (Get(0, mid).i < from) low = mid + 1;
+			else high = mid;
+		}
+		return GetCount() - low;
+	}
+
+	// Sum of a numeric column over the last n rows
+	double Sum(int column, size_t n) const
+	{
+		const ColumnCell* first;
+		const ColumnCell* second;
+		size_t firstsize, secondsize;
+		GetSegments(column, n, first, firstsize, second, secondsize);
+		if (firstsize == 0) return 0.0;
+		if (Traits::GetColumns()[column].type == COLUMN_FLOAT64) return ScanSum(&first->d, firstsize) + ScanSum(&second->d, secondsize);
+		return (double)(ScanSum(&first->i, firstsize) + ScanSum(&second->i, secondsize));
+	}
+
+	// Mean of a numeric column over the last n rows, 0 if there are none
+	double Mean(int column, size_t n) const
+	{
+		n = min(n, GetCount());
+		return n == 0 ? 0.0 : Sum(column, n) / n;
+	}
+
+	// Variance of a numeric column over the last n rows, 0 if there are fewer than two
+	double Variance(int column, size_t n) const
+	{
+		n = min(n, GetCount());
+		if (n < 2) return 0.0;
+		double mean = Mean(column, n);
+		bool isdouble = Traits::GetColumns()[column].type == COLUMN_FLOAT64;
+		double sum = 0;
+		for (size_t i = GetCount() - n; i < GetCount(); i++)
+		{
+			ColumnCell cell = Get(column, i);
+			double d = (isdouble ? cell.d : (double)cell.i) - mean;
+			sum += d * d;
+		}
+		return sum / (n - 1);
+	}
+
+	// Get the bytes of memory held by the columns
+	size_t GetBytes() const
+	{
+		size_t bytes = 0;
+		for (auto c = columns.begin(); c != columns.end(); c++) bytes += c->capacity() * sizeof(ColumnCell);
+		return bytes;
+	}
+};
+
+/*
+* History of the last rows of each product of a data type, a HistoryRing per product.
+* Values are mapped onto rows by ColumnarTraits<V>, as for the columnar store; string columns
+* hold codes into the dictionary of the history. A value may be several rows (a Position is a row per book).
+*/
+template<typename V>
+class HistoryStore
+{
+private:
+	typedef ColumnarTraits<V> Traits;
+
+	size_t capacity;
+	unordered_map<string, long long> codes;
+	vector<string> strings;
+	//Ring of each product code, nullptr for codes that are not products
+	vector<HistoryRing<V>*> rings;
+	long long lasttimestamp;
+
+public:
+	//Ctor and Dtor
+	HistoryStore(size_t c)
+	{
+		capacity = c;
+		lasttimestamp = 0;
+	}
+	~HistoryStore()
+	{
+		for (auto r = rings.begin(); r != rings.end(); r++) delete *r;
+	}
+	HistoryStore(const HistoryStore&) = delete;
+	HistoryStore& operator=(const HistoryStore&) = delete;
+
+	// Get the code of a string, adding it to the dictionary if it is new
+	long long Code(const string& s)
+	{
+		auto it = codes.find(s);
+		if (it != codes.end()) return it->second;
+		long long code = (long long)strings.size();
+		codes[s] = code;
+		strings.push_back(s);
+		return code;
+	}
+
+	// Get the string of a code
+	const string& GetString(long long code) const
+	{
+		return strings[code];
+	}
+
+	// Append a row to the ring of its product (the second column)
+	void AppendRow(const ColumnCell* row)
+	{
+		size_t code = (size_t)row[1].i;
+		if (code >= rings.size()) rings.resize(code + 1, nullptr);
+		if (rings[code] == nullptr) rings[code] = new HistoryRing<V>(capacity);
+		rings[code]->Push(row);
+	}
+
+	// Append the rows of a value, stamped now
+	void Append(const V& data)
+	{
+		long long timestamp = max(ColumnarTimestamp(), lasttimestamp);
+		lasttimestamp = timestamp;
+		Traits::Write(*this, timestamp, data);
+	}
+
+	// Get the ring of a product, nullptr if it has no rows
+	const HistoryRing<V>* GetRing(const string& productId) const
+	{
+		auto it = codes.find(productId);
+		if (it == codes.end() || (size_t)it->second >= rings.size()) return nullptr;
+		return rings[it->second];
+	}
+
+	// Get the maximum number of rows held per product
+	size_t GetCapacity() const
+	{
+		return capacity;
+	}
+
+	// Get the bytes of memory held by the rings
+	size_t GetBytes() const
+	{
+		size_t bytes = rings.capacity() * sizeof(HistoryRing<V>*);
+		for (auto r = rings.begin(); r != rings.end(); r++)
+		{
+			if (*r != nullptr) bytes += sizeof(HistoryRing<V>) + (*r)->GetBytes();
+		}
+		return bytes;
+	}
+};
+
+#endif // !HISTORYRING_HPP
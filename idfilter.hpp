@@ -0,0 +1,174 @@
+/*
+* idfilter.hpp
+* Compact sets of ids for duplicate detection
+* Author: Tengxiao Fan
+*/
+
+#ifndef IDFILTER_HPP
+#define IDFILTER_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// 64-bit fingerprint of an id (FNV-1a with a final mix), never 0
+unsigned long long Fingerprint(const string& id)
+{
+	unsigned long long h = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < id.size(); i++)
+	{
+		h ^= (unsigned char)id[i];
+		h *= 0x100000001b3ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h == 0 ? 1 : h;
+}
+
+/*
+* Set of id fingerprints: open addressing with linear probing and backward-shift
+* deletion, 8 bytes per bucket at no more than half load.
+*/
+class FingerprintSet
+{
+private:
+	vector<unsigned long long> keys;
+	size_t count;
+
+	// Find the bucket of a key, or the empty bucket where it would go
+	size_t Bucket(unsigned long long key) const
+	{
+		size_t mask = keys.size() - 1;
+		size_t i = key & mask;
+		while (keys[i] != 0 && keys[i] != key) i = (i + 1) & mask;
+		return i;
+	}
+
+	// Double the table
+	void Grow()
+	{
+		vector<unsigned long long> old = keys;
+		keys = vector<unsigned long long>(old.size() * 2, 0);
+		for (size_t i = 0; i < old.size(); i++)
+		{
+			if (old[i] != 0) keys[Bucket(old[i])] = old[i];
+		}
+	}
+
+public:
+	//Ctor and Dtor
+	FingerprintSet()
+	{
+		keys = vector<unsigned long long>(1024, 0);
+		count = 0;
+	}
+	~FingerprintSet() = default;
+
+	// Is a fingerprint in the set
+	bool Contains(unsigned long long key) const
+	{
+		return keys[Bucket(key)] != 0;
+	}
+
+	// Add a fingerprint, returns false if it was already there
+	bool Insert(unsigned long long key)
+	{
+		if ((count + 1) * 2 > keys.size()) Grow();
+		size_t i = Bucket(key);
+		if (keys[i] != 0) return false;
+		keys[i] = key;
+		count++;
+		return true;
+	}
+
+	// Remove a fingerprint, shifting back the entries that probed past it
+	void Erase(unsigned long long key)
+	{
+		size_t mask = keys.size() - 1;
+		size_t i = Bucket(key);
+		if (keys[i] == 0) return;
+		size_t j = i;
+		while (true)
+		{
+			j = (j + 1) & mask;
+			if (keys[j] == 0) break;
+			size_t home = keys[j] & mask;
+			//Move j back to i if its home is not cyclically in (i, j]
+			if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j)))
+			{
+				keys[i] = keys[j];
+				i = j;
+			}
+		}
+		keys[i] = 0;
+		count--;
+	}
+
+	// Get the number of fingerprints
+	size_t GetSize() const
+	{
+		return count;
+	}
+};
+
+/*
+* Blocked bloom filter on id fingerprints, sized for an expected number of ids:
+* all the probes of an id fall in one 512-bit block (a cache line), so a lookup
+* touches one line. With 16 bits per id and 8 probes the false positive rate
+* is about 0.2% at that size.
+*/
+class BloomFilter
+{
+private:
+	static const int Probes = 8;
+	static const int BlockWords = 8;
+	vector<unsigned long long> bits;
+	unsigned long long blocks;
+
+	// First word of the block of a fingerprint
+	size_t Block(unsigned long long key) const
+	{
+		return (size_t)(((key >> 32) * blocks) >> 32) * BlockWords;
+	}
+
+public:
+	//Ctor and Dtor
+	BloomFilter(size_t expected = 1 << 20)
+	{
+		blocks = (expected * 16 + 511) / 512;
+		if (blocks == 0) blocks = 1;
+		bits = vector<unsigned long long>(blocks * BlockWords, 0);
+	}
+	~BloomFilter() = default;
+
+	// Add a fingerprint
+	void Insert(unsigned long long key)
+	{
+		unsigned long long* block = bits.data() + Block(key);
+		//Double hashing within the block from the low half of the fingerprint
+		unsigned h1 = (unsigned)key, h2 = ((unsigned)key >> 16) | 1;
+		for (int p = 0; p < Probes; p++)
+		{
+			unsigned b = (h1 + p * h2) & 511;
+			block[b >> 6] |= 1ULL << (b & 63);
+		}
+	}
+
+	// Might a fingerprint have been added (no false negatives)
+	bool MayContain(unsigned long long key) const
+	{
+		const unsigned long long* block = bits.data() + Block(key);
+		unsigned h1 = (unsigned)key, h2 = ((unsigned)key >> 16) | 1;
+		for (int p = 0; p < Probes; p++)
+		{
+			unsigned b = (h1 + p * h2) & 511;
+			//Most lookups are of new ids, which miss on the first probes
+			if (((block[b >> 6] >> (b & 63)) & 1) == 0) return false;
+		}
+		return true;
+	}
+};
+
+#endif // !IDFILTER_HPP
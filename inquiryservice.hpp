@@ -7,14 +7,36 @@
 #ifndef INQUIRY_SERVICE_HPP
 #define INQUIRY_SERVICE_HPP
 
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "pricingservice.hpp"
+#include "timerwheel.hpp"
+#include "archivesegment.hpp"
+#include "serializer.hpp"
+#include "eventarena.hpp"
 
 // Various inqyury states
 enum InquiryState { RECEIVED, QUOTED, DONE, REJECTED, CUSTOMER_REJECTED };
 
+// Allowed transitions of an inquiry, from (row) to (column)
+const bool InquiryTransitions[5][5] =
+{
+	//RECEIVED QUOTED DONE   REJECTED CUSTOMER_REJECTED
+	{ false,   true,  false, true,    false },	//RECEIVED
+	{ false,   false, true,  true,    true },	//QUOTED
+	{ false,   false, false, false,   false },	//DONE
+	{ false,   false, false, false,   false },	//REJECTED
+	{ false,   false, false, false,   false },	//CUSTOMER_REJECTED
+};
+
 /**
  * Inquiry object modeling a customer inquiry from a client.
+ * The record is compact and fixed width: the product is interned, the id is held
+ * in a fixed-width field (up to 15 chars) and the price in integer ticks.
  * Type T is the product type.
  */
 template<typename T>
@@ -24,11 +46,17 @@ class Inquiry
 public:
 
   // ctor for an inquiry
-	Inquiry() {}
+	Inquiry() : inquiryId{}, price(0), quantity(0), side(BUY), state(RECEIVED) {}
   Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state);
 
   // Get the inquiry ID
-  const string& GetInquiryId() const;
+  string GetInquiryId() const;
+
+  // Get the inquiry ID without a copy
+  const char* GetInquiryIdChars() const
+  {
+	  return inquiryId;
+  }
 
   // Get the product
   const T& GetProduct() const;
@@ -40,10 +68,10 @@ public:
   long GetQuantity() const;
 
   // Get the price that we have responded back with
-  double GetPrice();
+  double GetPrice() const;
 
   // Get the current state on the inquiry
-  InquiryState GetState();
+  InquiryState GetState() const;
 
   //Set the state
   void SetState(InquiryState s)
@@ -54,45 +82,82 @@ public:
   //Set the price
   void SetPrice(double p)
   {
-	  price = p;
+	  price = PriceToTicks(p);
   }
 
   //Output function
   ostream& Output(ostream& file)
   {
-	  file << GetProduct().GetProductId() << "," << GetInquiryId() << ",";
-	  if (GetSide() == BUY)
-	  {
-		  file << "BUY,";
-	  }
-	  else if (GetSide() == SELL)
-	  {
-		  file << "SELL,";
-	  }
-	  file << GetQuantity() << "," << GetPrice() << ",";
-	  if (GetState() == DONE)
-	  {
-		  file << "DONE\n";
-	  }
-	  return file;
+	  return Serialize(file, *this);
   }
 
 private:
-  string inquiryId;
-  T product;
-  Side side;
+  char inquiryId[16];
+  long long price;
   long quantity;
-  double price;
+  int product = -1;
+  Side side;
   InquiryState state;
 
 };
 
 
+/*
+* CSV line of an inquiry: the product, the id, the side, the quantity, the price and the final state
+*/
+template<typename T>
+struct SerializerTraits<Inquiry<T>>
+{
+	static const bool Defined = true;
+	static size_t MaxSize(const Inquiry<T>& data)
+	{
+		return data.GetProduct().GetProductId().size() + 16 + 5 + LongTextSize + FixedTextSize + 22;
+	}
+	static size_t Write(const Inquiry<T>& data, char* buf)
+	{
+		char* p = buf + WriteText(buf, data.GetProduct().GetProductId());
+		*p++ = ',';
+		p += WriteText(p, data.GetInquiryIdChars(), strlen(data.GetInquiryIdChars()));
+		*p++ = ',';
+		if (data.GetSide() == BUY) p += WriteText(p, "BUY,", 4);
+		else if (data.GetSide() == SELL) p += WriteText(p, "SELL,", 5);
+		p += WriteLong(p, data.GetQuantity());
+		*p++ = ',';
+		p += WriteFixed(p, data.GetPrice());
+		*p++ = ',';
+		if (data.GetState() == DONE) p += WriteText(p, "DONE\n", 5);
+		else if (data.GetState() == REJECTED) p += WriteText(p, "REJECTED\n", 9);
+		else if (data.GetState() == CUSTOMER_REJECTED) p += WriteText(p, "CUSTOMER_REJECTED\n", 18);
+		return p - buf;
+	}
+};
+
+/**
+ * Compact fixed-width record of a finished inquiry for the archive.
+ */
+struct InquiryRecord
+{
+	char inquiryId[16];
+	char product[12];
+	Side side;
+	InquiryState state;
+	long quantity;
+	double price;
+};
+
 template <typename T>
 class InquiryConnector;
 
 /**
  * Service for customer inquirry objects.
+ * Inquiries in flight are held together in a state table: a new inquiry (RECEIVED) is quoted
+ * at once from the latest price of its product, skewed by its size, and sent to the client
+ * through the connector. The client answer (DONE or CUSTOMER_REJECTED) comes back through
+ * the connector; a quote left unanswered for the timeout is CUSTOMER_REJECTED.
+ * Inquiries with no price to quote are REJECTED. Listeners get every finished inquiry with ProcessAdd.
+ * With an archive enabled, finished inquiries are archived, and only the most recent ones are kept
+ * in the hot map. Without one, every finished inquiry stays in the hot map.
+ * The clock of the timeouts is in ticks, advanced by the connector.
  * Keyed on inquiry identifier (NOTE: this is NOT a product identifier since each inquiry must be unique).
  * Type T is the product type.
  */
@@ -101,48 +166,83 @@ class InquiryService : public Service<string,Inquiry <T> >
 {
 
 private:
+	//Recently finished inquiries, in the order they finished
 	map<string, Inquiry<T>> inquirymap;
+	deque<string> hotorder;
+	size_t hotcapacity;
+	//Archive of all the finished inquiries, nullptr if not enabled
+	ArchiveSegment<InquiryRecord>* archive;
+	Inquiry<T> archived;
 	vector<ServiceListener<Inquiry<T>>*> listeners;
 	InquiryConnector<T>* connector;
 
+	//State table of the inquiries in flight, pooled by slot, with the handle of their timeout
+	unordered_map<string, int> liveslots;
+	vector<Inquiry<T>> liveinquiries;
+	vector<int> timeouts;
+	vector<int> freeslots;
+	TimerWheel timers;
+	long timeout;
+
+	//Prices to quote from and the skew per million of size
+	const PriceSnapshots* snapshots;
+	double skew;
+
 public:
 	//Ctor and Dtor
 	InquiryService()
 	{
+		archive = nullptr;
+		hotcapacity = 10000;
 		inquirymap = map<string, Inquiry<T>>();
 		listeners = vector<ServiceListener<Inquiry<T>>*>();
 		connector = new InquiryConnector<T>(this);
+		timeout = 100;
+		snapshots = nullptr;
+		skew = 1.0 / 1024.0;
+	}
+	~InquiryService()
+	{
+		delete archive;
 	}
-	~InquiryService() = default;
+	InquiryService(const InquiryService&) = delete;
+	InquiryService& operator=(const InquiryService&) = delete;
 
 	// Get data on our service given a key
 	Inquiry<T>& GetData(string key)
 	{
-		return inquirymap[key];
+		auto it = liveslots.find(key);
+		if (it != liveslots.end()) return liveinquiries[it->second];
+		auto done = inquirymap.find(key);
+		if (done != inquirymap.end()) return done->second;
+		InquiryRecord record;
+		if (archive != nullptr && archive->Find([&key](const InquiryRecord& r) { return UnpackString(r.inquiryId, sizeof(r.inquiryId)) == key; }, record))
+		{
+			archived = Inquiry<T>(key, FindProduct<T>(UnpackString(record.product, sizeof(record.product))), record.side, record.quantity, record.price, record.state);
+		}
+		else
+		{
+			archived = Inquiry<T>();
+		}
+		return archived;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
 	void OnMessage(Inquiry<T>& data)
 	{
-		string key = data.GetInquiryId();
 		InquiryState state = data.GetState();
-		//std::cout << data.GetInquiryId() << "," << data.GetPrice() << "," << data.GetSide() << "," << data.GetQuantity() << "," << data.GetState() << endl;
 		if (state == RECEIVED)
 		{
-			inquirymap[key] = data;
-			connector->Publish(data);
+			Receive(data);
 		}
-		else if (state == QUOTED)
+		else if (state == DONE || state == CUSTOMER_REJECTED)
 		{
-			data.SetState(DONE);
-			inquirymap[key] = data;
-			for (auto i = listeners.begin(); i != listeners.end(); i++)
-			{
-				(*i)->ProcessAdd(data);
-			}
+			//Answer of the client to a quote
+			auto it = liveslots.find(data.GetInquiryId());
+			if (it == liveslots.end()) return;
+			timers.Cancel(timeouts[it->second]);
+			Finish(it->second, state);
 		}
-		//std::cout << data.GetInquiryId() << "," << data.GetPrice() << "," << data.GetSide() << "," << data.GetQuantity() << "," << data.GetState() << endl;
-		
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -163,46 +263,189 @@ public:
 		return connector;
 	}
 
+	// Allocate the transient objects of the events read by the connector in an arena, nullptr for the global heap
+	void SetArena(EventArena* arena)
+	{
+		connector->SetArena(arena);
+	}
+
+	// Set the prices to quote from
+	void SetPriceSnapshots(const PriceSnapshots* s)
+	{
+		snapshots = s;
+	}
+
+	// Set the skew added to the half spread per million of size
+	void SetSkew(double s)
+	{
+		skew = s;
+	}
+
+	// Set the number of ticks a client has to answer a quote
+	void SetTimeout(long ticks)
+	{
+		timeout = max(1L, ticks);
+	}
+
+	// Get the current tick
+	unsigned long long GetTime() const
+	{
+		return timers.GetTime();
+	}
+
+	// Advance the clock to a tick, expiring the quotes left unanswered
+	void AdvanceTime(unsigned long long t)
+	{
+		timers.Advance(t, [this](unsigned long long slot) { Finish((int)slot, CUSTOMER_REJECTED); });
+	}
+
+	// Get the number of inquiries in flight
+	size_t GetLiveCount() const
+	{
+		return liveslots.size();
+	}
+
+	// Archive finished inquiries to a file (truncated, as the archive lives as long as the service) and
+	// keep only the most recent ones in the hot map; enable it before the first inquiry
+	// (throws runtime_error if the file cannot be opened, or later written)
+	void EnableArchive(const string& filename, size_t segmentsize = 4096)
+	{
+		ArchiveSegment<InquiryRecord>* opened = new ArchiveSegment<InquiryRecord>(filename, segmentsize);
+		delete archive;
+		archive = opened;
+	}
+
+	// Set the number of finished inquiries kept in the hot map when archiving
+	void SetHotCapacity(size_t n)
+	{
+		hotcapacity = n;
+	}
+
+	// Get the number of finished inquiries in the hot map
+	size_t GetHotCount() const
+	{
+		return inquirymap.size();
+	}
+
+	// Get the archive of finished inquiries, nullptr if not enabled
+	ArchiveSegment<InquiryRecord>* GetArchive()
+	{
+		return archive;
+	}
+
 	// Send a quote back to the client
 	void SendQuote(const string& inquiryId, double price)
 	{
-		Inquiry<T>& inq = inquirymap[inquiryId];
+		auto it = liveslots.find(inquiryId);
+		if (it == liveslots.end()) return;
+		Inquiry<T>& inq = liveinquiries[it->second];
+		if (!InquiryTransitions[inq.GetState()][QUOTED]) return;
 		inq.SetPrice(price);
-		for (auto i = listeners.begin(); i != listeners.end(); i++)
-		{
-			(*i)->ProcessAdd(inq);
-		}
+		inq.SetState(QUOTED);
+		timeouts[it->second] = timers.Schedule(timers.GetTime() + timeout, it->second);
+		connector->Publish(inq);
 	}
 
 	// Reject an inquiry from the client
 	void RejectInquiry(const string& inquiryId)
 	{
-		inquirymap[inquiryId].GetState() = REJECTED;
+		auto it = liveslots.find(inquiryId);
+		if (it == liveslots.end()) return;
+		if (liveinquiries[it->second].GetState() == QUOTED) timers.Cancel(timeouts[it->second]);
+		Finish(it->second, REJECTED);
+	}
+
+private:
+	// Take a new inquiry into the state table and quote it
+	void Receive(const Inquiry<T>& data)
+	{
+		if (liveslots.count(data.GetInquiryId()) || inquirymap.count(data.GetInquiryId())) return;
+		int slot;
+		if (!freeslots.empty())
+		{
+			slot = freeslots.back();
+			freeslots.pop_back();
+			liveinquiries[slot] = data;
+		}
+		else
+		{
+			slot = (int)liveinquiries.size();
+			liveinquiries.push_back(data);
+			timeouts.push_back(-1);
+		}
+		liveslots[data.GetInquiryId()] = slot;
+
+		double mid, spread;
+		if (snapshots == nullptr || !snapshots->Read(data.GetProduct().GetProductId(), mid, spread))
+		{
+			Finish(slot, REJECTED);
+			return;
+		}
+		//The client buys at our offer and sells at our bid, larger sizes pay more
+		double halfspread = spread / 2.0 + skew * data.GetQuantity() / 1000000.0;
+		double price = data.GetSide() == BUY ? mid + halfspread : mid - halfspread;
+		SendQuote(data.GetInquiryId(), price);
+	}
+
+	// Move an inquiry to a final state, notify the listeners and free its slot
+	void Finish(int slot, InquiryState state)
+	{
+		Inquiry<T>& inq = liveinquiries[slot];
+		if (!InquiryTransitions[inq.GetState()][state]) return;
+		inq.SetState(state);
+		string key = inq.GetInquiryId();
+		Inquiry<T>& done = inquirymap[key];
+		done = inq;
+		liveslots.erase(key);
+		freeslots.push_back(slot);
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(done);
+		}
+
+		if (archive == nullptr) return;
+		InquiryRecord record;
+		PackString(record.inquiryId, sizeof(record.inquiryId), key);
+		PackString(record.product, sizeof(record.product), done.GetProduct().GetProductId());
+		record.side = done.GetSide();
+		record.state = done.GetState();
+		record.quantity = done.GetQuantity();
+		record.price = done.GetPrice();
+		//Queued first, so that a write failure of the archive leaves the record queued for eviction
+		hotorder.push_back(key);
+		archive->Append(record);
+		while (hotorder.size() > hotcapacity)
+		{
+			inquirymap.erase(hotorder.front());
+			hotorder.pop_front();
+		}
 	}
 
 };
 
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state) :
-  product(_product)
+Inquiry<T>::Inquiry(string _inquiryId, const T &_product, Side _side, long _quantity, double _price, InquiryState _state)
 {
-  inquiryId = _inquiryId;
+  static_assert(sizeof(inquiryId) > IdWidth, "the inquiry id field must hold a generated id");
+  product = InternTable<T>::Intern(_product.GetProductId(), _product);
+  PackString(inquiryId, sizeof(inquiryId) - 1, _inquiryId);
+  inquiryId[sizeof(inquiryId) - 1] = 0;
   side = _side;
   quantity = _quantity;
-  price = _price;
+  price = PriceToTicks(_price);
   state = _state;
 }
 
 template<typename T>
-const string& Inquiry<T>::GetInquiryId() const
+string Inquiry<T>::GetInquiryId() const
 {
-  return inquiryId;
+  return string(inquiryId);
 }
 
 template<typename T>
 const T& Inquiry<T>::GetProduct() const
 {
-  return product;
+  return InternTable<T>::Get(product);
 }
 
 template<typename T>
@@ -218,55 +461,94 @@ long Inquiry<T>::GetQuantity() const
 }
 
 template<typename T>
-double Inquiry<T>::GetPrice()
+double Inquiry<T>::GetPrice() const
 {
-  return price;
+  return TicksToPrice(price);
 }
 
 template<typename T>
-InquiryState Inquiry<T>::GetState()
+InquiryState Inquiry<T>::GetState() const
 {
   return state;
 }
 
 
 /*
-* Connector
+* Connector: reads inquiries from the client and sends them our quotes.
+* The simulated client accepts each quote after a delay in ticks.
 */
 template<typename T>
 class InquiryConnector :public Connector<Inquiry<T>>
 {
 private:
 	InquiryService<T>* service;
+	//Client answers queued with the tick they are due
+	deque<pair<unsigned long long, Inquiry<T>>> responses;
+	long delay;
+	//Arena of the transient objects of a line, nullptr for the global heap
+	EventArena* arena;
 public:
 	//Ctor and Dtor
 	InquiryConnector(InquiryService<T>* s)
 	{
 		service = s;
+		delay = 1;
+		arena = nullptr;
 	}
 	~InquiryConnector() = default;
 
-	//Publish data 
+	// Allocate the transient objects of the events read in an arena, nullptr for the global heap
+	void SetArena(EventArena* a)
+	{
+		arena = a;
+	}
+
+	// Set the delay of the client answers in ticks
+	void SetDelay(long ticks)
+	{
+		delay = max(0L, ticks);
+	}
+
+	//Publish data: send a quote to the client and queue its answer
 	void Publish(Inquiry<T>& data)
 	{
-		InquiryState state = data.GetState();
-		if (state == RECEIVED)
+		if (data.GetState() == QUOTED)
 		{
-			data.SetState(QUOTED);
-			this->Subscribe(data);
+			Inquiry<T> answer = data;
+			answer.SetState(DONE);
+			responses.push_back(make_pair(service->GetTime() + delay, answer));
 		}
-		
 	}
 
-	//Subscribe data- from connector
+	// Deliver the client answers due by the current tick
+	void Deliver()
+	{
+		while (!responses.empty() && responses.front().first <= service->GetTime())
+		{
+			Inquiry<T> answer = responses.front().second;
+			responses.pop_front();
+			service->OnMessage(answer);
+		}
+	}
+
+	// Move the clock one tick
+	void Tick()
+	{
+		service->AdvanceTime(service->GetTime());
+		Deliver();
+	}
+
+	//Subscribe data- from connector, one tick per line
 	void Subscribe(ifstream& data)
 	{
 		string line;
 
 		while (getline(data, line))
 		{
-			string ele = "";
-			vector<string> elements;
+			EventScope scope(arena);
+			pmr::memory_resource* resource = ArenaResource(arena);
+			pmr::string ele(resource);
+			pmr::vector<pmr::string> elements(resource);
 			for (int i = 0; i < line.size(); i++)
 			{
 				if (line[i] == ',')
@@ -281,11 +563,11 @@ public:
 			}
 			elements.push_back(ele);
 			//std::cout << elements[2] << endl;
-			string inquiryid = elements[0];
-			string cusip = elements[1];
+			string inquiryid(elements[0]);
+			string cusip(elements[1]);
 			Side side = BUY;
 			if (elements[2] == "SELL") side = SELL;
-			long quantity = stol(elements[3]);
+			long quantity = strtol(elements[3].c_str(), nullptr, 10);
 			double price = FractionaltoPrice(elements[4]);
 			InquiryState state;
 			if (elements[5] == "RECEIVED") state = RECEIVED;
@@ -297,8 +579,11 @@ public:
 			T product = MakeBond(cusip);
 			Inquiry<T> inquiry(inquiryid, product, side, quantity, price, state);
 			service->OnMessage(inquiry);
+			Tick();
 			//std::cout << cusip << "," << mid << "," << spread<<std::endl;
 		}
+		//Let the client answer what is still open
+		while (!responses.empty()) Tick();
 	}
 
 	//Subscribe data
@@ -0,0 +1,251 @@
+/*
+* journal.hpp
+* Append-only checksummed write-ahead journal
+* Author: Tengxiao Fan
+*/
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// When the journal is flushed to disk
+enum FsyncPolicy { FSYNC_NEVER, FSYNC_GROUP, FSYNC_EVERY };
+
+// CRC-32 (IEEE) of a buffer, eight bytes per step (slicing-by-8)
+unsigned int Crc32(const void* data, size_t size, unsigned int crc = 0)
+{
+	static unsigned int table[8][256];
+	static bool built = false;
+	if (!built)
+	{
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			unsigned int c = i;
+			for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[0][i] = c;
+		}
+		for (unsigned int i = 0; i < 256; i++)
+		{
+			for (int t = 1; t < 8; t++) table[t][i] = (table[t - 1][i] >> 8) ^ table[0][table[t - 1][i] & 0xFF];
+		}
+		built = true;
+	}
+	const unsigned char* p = (const unsigned char*)data;
+	crc = ~crc;
+	while (size >= 8)
+	{
+		unsigned int lo, hi;
+		memcpy(&lo, p, 4);
+		memcpy(&hi, p + 4, 4);
+		lo ^= crc;
+		crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF] ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24] ^
+			table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF] ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+		p += 8;
+		size -= 8;
+	}
+	while (size-- > 0) crc = table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+/*
+* Write-ahead journal of fixed-size records (R must be trivially copyable).
+* Each entry is a header (sequence number and CRC-32 of sequence and record) followed by the record.
+* Entries are group committed: they are buffered and written together once a group is full
+* or on Commit(), and fsynced according to the policy. A failed write keeps the bytes not written
+* for the next commit and marks the journal failed until a commit succeeds.
+* A journal that could not be opened (see IsOpen) buffers nothing: its appends are dropped and mark it failed.
+* On open, the journal is scanned and cut after its last valid entry, so a torn write
+* at a crash is dropped and new entries continue the sequence.
+*/
+template<typename R>
+class Journal
+{
+private:
+	struct Header
+	{
+		unsigned long long sequence;
+		unsigned int crc;
+		unsigned int size;
+	};
+
+	int fd;
+	FsyncPolicy policy;
+	size_t groupsize;
+	vector<char> buffer;
+	size_t pending;
+	unsigned long long sequence;
+	bool failed;
+
+	static unsigned int Checksum(const Header& header, const R& record)
+	{
+		unsigned int crc = Crc32(&header.sequence, sizeof(header.sequence));
+		return Crc32(&record, sizeof(R), crc);
+	}
+
+public:
+	//Ctor and Dtor
+	Journal(const string& filename, FsyncPolicy p = FSYNC_GROUP, size_t group = 256)
+	{
+		policy = p;
+		groupsize = group > 0 ? group : 1;
+		pending = 0;
+		sequence = 0;
+		failed = false;
+		buffer.reserve(groupsize * (sizeof(Header) + sizeof(R)));
+		fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+		if (fd < 0) return;
+		//Keep the valid prefix and continue its sequence
+		off_t end = Scan(fd, [](const R&) {}, sequence);
+		if (ftruncate(fd, end) != 0)
+		{
+			close(fd);
+			fd = -1;
+			return;
+		}
+		lseek(fd, end, SEEK_SET);
+	}
+	~Journal()
+	{
+		Commit();
+		if (fd >= 0) close(fd);
+	}
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+
+	// Is the journal open
+	bool IsOpen() const
+	{
+		return fd >= 0;
+	}
+
+	// Did the last commit fail, leaving entries not written or not synced
+	bool HasFailed() const
+	{
+		return failed;
+	}
+
+	// Get the number of entries in the journal
+	unsigned long long GetSequence() const
+	{
+		return sequence;
+	}
+
+	// Append a record, committing the group once it is full
+	void Append(const R& record)
+	{
+		if (fd < 0)
+		{
+			failed = true;
+			return;
+		}
+		Header header;
+		header.sequence = ++sequence;
+		header.size = sizeof(R);
+		header.crc = Checksum(header, record);
+		const char* h = (const char*)&header;
+		const char* r = (const char*)&record;
+		buffer.insert(buffer.end(), h, h + sizeof(Header));
+		buffer.insert(buffer.end(), r, r + sizeof(R));
+		pending++;
+		if (pending >= groupsize || policy == FSYNC_EVERY) Commit();
+	}
+
+	// Write the buffered entries, and fsync them unless the policy is FSYNC_NEVER;
+	// returns false if they are not all durable (the rest stays buffered)
+	bool Commit()
+	{
+		if (fd < 0)
+		{
+			failed = true;
+			return false;
+		}
+		size_t done = 0;
+		while (done < buffer.size())
+		{
+			ssize_t n = write(fd, buffer.data() + done, buffer.size() - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			done += n;
+		}
+		buffer.erase(buffer.begin(), buffer.begin() + done);
+		pending = buffer.size() / (sizeof(Header) + sizeof(R));
+		bool written = buffer.empty();
+		bool synced = true;
+		//Sync the new entries, or retry a sync that failed
+		if (written && (done > 0 || failed) && policy != FSYNC_NEVER)
+		{
+			int r;
+			while ((r = fdatasync(fd)) != 0 && errno == EINTR) {}
+			synced = r == 0;
+		}
+		failed = !written || !synced;
+		return !failed;
+	}
+
+	// Get the number of entries a journal file can hold, from its size
+	static unsigned long long GetEntryCount(const string& filename)
+	{
+		int in = open(filename.c_str(), O_RDONLY);
+		if (in < 0) return 0;
+		off_t size = lseek(in, 0, SEEK_END);
+		close(in);
+		return size > 0 ? (unsigned long long)size / (sizeof(Header) + sizeof(R)) : 0;
+	}
+
+	// Read the valid entries of a journal file in order from an entry number, calling f(record);
+	// returns the number of entries read
+	template<typename F>
+	static unsigned long long Replay(const string& filename, F f, unsigned long long from = 0)
+	{
+		int in = open(filename.c_str(), O_RDONLY);
+		if (in < 0) return 0;
+		unsigned long long count = from;
+		Scan(in, f, count);
+		close(in);
+		return count > from ? count - from : 0;
+	}
+
+private:
+	// Read entries from entry number count (entries are fixed size) until the first invalid one,
+	// returns the offset after the last valid one
+	template<typename F>
+	static off_t Scan(int file, F f, unsigned long long& count)
+	{
+		const size_t entry = sizeof(Header) + sizeof(R);
+		vector<char> block(entry * 4096);
+		off_t offset = (off_t)(count * entry);
+		lseek(file, offset, SEEK_SET);
+		size_t filled = 0;
+		while (true)
+		{
+			ssize_t n = read(file, block.data() + filled, block.size() - filled);
+			if (n > 0) filled += n;
+			size_t used = 0;
+			while (filled - used >= entry)
+			{
+				Header header;
+				R record;
+				memcpy(&header, block.data() + used, sizeof(Header));
+				memcpy(&record, block.data() + used + sizeof(Header), sizeof(R));
+				if (header.size != sizeof(R) || header.sequence != count + 1 || header.crc != Checksum(header, record)) return offset;
+				f(record);
+				count++;
+				used += entry;
+				offset += entry;
+			}
+			if (n <= 0) return offset;
+			memmove(block.data(), block.data() + used, filled - used);
+			filled -= used;
+		}
+	}
+};
+
+#endif // !JOURNAL_HPP
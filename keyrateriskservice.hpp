@@ -0,0 +1,277 @@
+/**
+ * keyrateriskservice.hpp
+ * Defines the data types and Service for key-rate risk by tenor bucket.
+ *
+ * @author Tengxiao Fan
+ */
+#ifndef KEY_RATE_RISK_SERVICE_HPP
+#define KEY_RATE_RISK_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include "soa.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+/**
+ * Key-rate PV01 risk: the PV01 of a product split onto tenor buckets.
+ * Type T is the product type.
+ */
+template<typename T>
+class KeyRatePV01
+{
+
+public:
+
+  // ctor for a key-rate PV01 value
+	KeyRatePV01() {}
+	KeyRatePV01(const T& _product, const vector<double>& _pv01s, long _quantity) :
+		product(_product), pv01s(_pv01s), quantity(_quantity) {}
+	KeyRatePV01(const T& _product, vector<double>&& _pv01s, long _quantity) :
+		product(_product), pv01s(move(_pv01s)), quantity(_quantity) {}
+
+  // Get the product on this key-rate PV01 value
+	const T& GetProduct() const
+	{
+		return product;
+	}
+
+  // Get the PV01 on each tenor bucket
+	const vector<double>& GetPV01s() const
+	{
+		return pv01s;
+	}
+
+  // Get the quantity that this risk value is associated with
+	long GetQuantity() const
+	{
+		return quantity;
+	}
+
+	//Output function
+	ostream& Output(ostream& file)
+	{
+		file << GetProduct().GetProductId();
+		for (auto p = pv01s.begin(); p != pv01s.end(); p++)
+		{
+			file << "," << (*p);
+		}
+		file << "," << GetQuantity() << endl;
+		return file;
+	}
+
+private:
+  T product;
+  vector<double> pv01s;
+  long quantity;
+
+};
+
+/*
+* Pre definition of a listener to the position
+*/
+template <typename T>
+class KeyRateRiskPositionListener;
+
+/**
+ * Key-Rate Risk Service to vend out PV01 by tenor bucket for each security and in aggregate.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class KeyRateRiskService : public Service<string, KeyRatePV01<T> >
+{
+private:
+	map<string, KeyRatePV01<T>> keyratemap;
+	vector<ServiceListener<KeyRatePV01<T>>*> listeners;
+	KeyRateRiskPositionListener<T>* position_listener;
+	TenorBuckets buckets;
+
+	//Per product slot: bucket weights (row-major, one row per slot), bucket mask and PV01 exposure
+	map<string, size_t> slots;
+	vector<T> products;
+	vector<double> weights;
+	vector<unsigned long long> masks;
+	vector<double> exposures;
+
+public:
+	//Ctor and Dtor
+	KeyRateRiskService()
+	{
+		keyratemap = map<string, KeyRatePV01<T>>();
+		listeners = vector<ServiceListener<KeyRatePV01<T>>*>();
+		position_listener = new KeyRateRiskPositionListener<T>(this);
+	}
+	~KeyRateRiskService() = default;
+
+	// Get data on our service given a key
+	virtual KeyRatePV01<T>& GetData(string key)
+	{
+		return keyratemap[key];
+	}
+
+	// The callback that a Connector should invoke for any new or updated data
+	virtual void OnMessage(KeyRatePV01<T>& data)
+	{
+		string key = data.GetProduct().GetProductId();
+		keyratemap[key] = data;
+		//Call all the listeners
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(data);
+		}
+	}
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	virtual void AddListener(ServiceListener<KeyRatePV01<T>>* listener)
+	{
+		listeners.push_back(listener);
+	}
+
+	// Get all listeners on the Service
+	virtual const vector<ServiceListener<KeyRatePV01<T>>*>& GetListeners() const
+	{
+		return listeners;
+	}
+
+	// Get the listener to the position service
+	KeyRateRiskPositionListener<T>* GetPositionListener()
+	{
+		return position_listener;
+	}
+
+	// Set the tenor buckets and rebuild the bucket weights of every product
+	void SetTenorBuckets(const TenorBuckets& b)
+	{
+		buckets = b;
+		size_t nb = buckets.GetSize();
+		weights = vector<double>(products.size() * nb);
+		for (size_t slot = 0; slot < products.size(); slot++)
+		{
+			double tenor = GetTenor(products[slot].GetProductId());
+			vector<double> w = buckets.GetWeights(tenor);
+			copy(w.begin(), w.end(), weights.begin() + slot * nb);
+			masks[slot] = buckets.GetMask(tenor);
+		}
+	}
+
+	// Get the tenor buckets
+	const TenorBuckets& GetTenorBuckets() const
+	{
+		return buckets;
+	}
+
+	// Add a position that the service will risk
+	void AddPosition(Position<T>& position)
+	{
+		const T& product = position.GetProduct();
+		string id = product.GetProductId();
+		size_t slot = GetSlot(product);
+		long quantity = position.GetAggregatePosition();
+		double pv01 = CaluculatePV01(id);
+		exposures[slot] = pv01 * quantity;
+
+		size_t nb = buckets.GetSize();
+		vector<double> pv01s(weights.begin() + slot * nb, weights.begin() + (slot + 1) * nb);
+		for (auto p = pv01s.begin(); p != pv01s.end(); p++)
+		{
+			(*p) *= pv01;
+		}
+		KeyRatePV01<T> krpv01(product, move(pv01s), quantity);
+		OnMessage(krpv01);
+	}
+
+	// Get the aggregate key-rate risk (PV01 times quantity) of all positions on each bucket
+	vector<double> GetAggregateKeyRateRisk() const
+	{
+		size_t nb = buckets.GetSize();
+		vector<double> risk(nb, 0.0);
+		double* out = risk.data();
+		const double* w = weights.data();
+		//Matrix-vector product: sum of exposure times the weight row of each slot
+		for (size_t slot = 0; slot < exposures.size(); slot++)
+		{
+			double e = exposures[slot];
+			const double* row = w + slot * nb;
+			for (size_t b = 0; b < nb; b++)
+			{
+				out[b] += e * row[b];
+			}
+		}
+		return risk;
+	}
+
+	// Get the aggregate risk of the positions on the buckets selected by a bitmask
+	double GetAggregateKeyRateRisk(unsigned long long mask) const
+	{
+		vector<double> risk = GetAggregateKeyRateRisk();
+		double total = 0;
+		for (size_t b = 0; b < risk.size() && b < 64; b++)
+		{
+			if (mask & (1ULL << b)) total += risk[b];
+		}
+		return total;
+	}
+
+	// Get the products that have weight on any of the buckets selected by a bitmask
+	vector<T> GetProducts(unsigned long long mask) const
+	{
+		vector<T> result;
+		for (size_t slot = 0; slot < products.size(); slot++)
+		{
+			if (masks[slot] & mask) result.push_back(products[slot]);
+		}
+		return result;
+	}
+
+private:
+	// Get the slot of a product, adding it with its bucket weights if it is new
+	size_t GetSlot(const T& product)
+	{
+		string id = product.GetProductId();
+		auto it = slots.find(id);
+		if (it != slots.end()) return it->second;
+
+		size_t slot = products.size();
+		double tenor = GetTenor(id);
+		vector<double> w = buckets.GetWeights(tenor);
+		slots[id] = slot;
+		products.push_back(product);
+		weights.insert(weights.end(), w.begin(), w.end());
+		masks.push_back(buckets.GetMask(tenor));
+		exposures.push_back(0.0);
+		return slot;
+	}
+};
+
+/*
+* Key-rate risk to position listener
+*/
+template<typename T>
+class KeyRateRiskPositionListener : public ServiceListener<Position<T>>
+{
+private:
+	KeyRateRiskService<T>* service;
+
+public:
+	//Ctor and Dtor
+	KeyRateRiskPositionListener(KeyRateRiskService<T>* s)
+	{
+		service = s;
+	}
+	~KeyRateRiskPositionListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Position<T>& data)
+	{
+		service->AddPosition(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Position<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Position<T>& data){}
+};
+
+#endif
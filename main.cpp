@@ -8,12 +8,17 @@
 #include "soa.hpp"
 #include "positionservice.hpp"
 #include "pricingservice.hpp"
+#include "yieldcurveservice.hpp"
 #include "marketdataservice.hpp"
 #include "tradebookingservice.hpp"
 #include "riskservice.hpp"
+#include "scenarioriskservice.hpp"
+#include "keyrateriskservice.hpp"
+#include "pnlservice.hpp"
 #include "algoexecutionservice.hpp"
 #include "algostreamingservice.hpp"
 #include "executionservice.hpp"
+#include "venueservice.hpp"
 #include "streamingservice.hpp"
 #include "GUIService.hpp"
 #include "inquiryservice.hpp"
@@ -33,18 +38,25 @@ int main()
 
 	//Make services
 	PricingService<Bond> pricingservice;
+	YieldCurveService<Bond> yieldcurveservice;
 	TradeBookingService<Bond> tradebookingservice;
 	PositionService<Bond> positionservice;
 	RiskService<Bond> riskservice;
+	ScenarioRiskService<Bond> scenarioriskservice;
+	KeyRateRiskService<Bond> keyrateriskservice;
+	PnLService<Bond> pnlservice;
 	MarketDataService<Bond> marketdataservice;
 	AlgoExecutionService<Bond> algoexecutionservice;
 	AlgoStreamingService<Bond> algostreamingservice;
 	ExecutionService<Bond> executionservice;
+	VenueService<Bond> venueservice;
 	StreamingService<Bond> streamingservice;
 	GUIService<Bond> guiservice;
 	InquiryService<Bond> inquiryservice;
 	HistoricalDataService<Position<Bond>> historicalpositionservice("POSITION");
 	HistoricalDataService<PV01<Bond>> historicalriskservice("RISK");
+	HistoricalDataService<KeyRatePV01<Bond>> historicalkeyrateservice("KEYRATE");
+	HistoricalDataService<PnL<Bond>> historicalpnlservice("PNL");
 	HistoricalDataService<ExecutionOrder<Bond>> historicalexecutionservice("EXECUTION");
 	HistoricalDataService<PriceStream<Bond>> historicalstreamservice("STREAMING");
 	HistoricalDataService<Inquiry<Bond>> historicalinquiryservice("INQUIRY");
@@ -52,20 +64,38 @@ int main()
 
 	//Add the listeners
 	tradebookingservice.AddListener(positionservice.GetTradeBookingListener());
+	tradebookingservice.AddListener(pnlservice.GetTradeBookingListener());
 	positionservice.AddListener(riskservice.GetPositionListener());
+	positionservice.AddListener(scenarioriskservice.GetPositionListener());
+	positionservice.AddListener(keyrateriskservice.GetPositionListener());
+	marketdataservice.AddListener(venueservice.GetMarketDataListener());
 	marketdataservice.AddListener(algoexecutionservice.GetMarketDataListener());
 	pricingservice.AddListener(algostreamingservice.GetPricingListener());
 	algoexecutionservice.AddListener(executionservice.GetAlgoExecutionListener());
-	executionservice.AddListener(tradebookingservice.GetExecutionListener());
+	executionservice.AddListener(venueservice.GetExecutionListener());
+	venueservice.AddListener(tradebookingservice.GetFillListener());
+	venueservice.AddListener(executionservice.GetVenueListener());
 	algostreamingservice.AddListener(streamingservice.GetAlgoStreamingListener());
 	pricingservice.AddListener(guiservice.GetPricingListener());
+	pricingservice.AddListener(yieldcurveservice.GetPricingListener());
+	pricingservice.AddListener(pnlservice.GetPricingListener());
 	positionservice.AddListener(historicalpositionservice.GetDataListener());
 	riskservice.AddListener(historicalriskservice.GetDataListener());
+	keyrateriskservice.AddListener(historicalkeyrateservice.GetDataListener());
+	pnlservice.AddListener(historicalpnlservice.GetDataListener());
 	executionservice.AddListener(historicalexecutionservice.GetDataListener());
 	streamingservice.AddListener(historicalstreamservice.GetDataListener());
 	inquiryservice.AddListener(historicalinquiryservice.GetDataListener());
+	inquiryservice.SetPriceSnapshots(&pricingservice.GetSnapshots());
 	
 
+	//Fields of the lines read go to an arena released every 64 lines
+	EventArena arena(1 << 16, 64);
+	tradebookingservice.SetArena(&arena);
+	pricingservice.SetArena(&arena);
+	marketdataservice.SetArena(&arena);
+	inquiryservice.SetArena(&arena);
+
 	//Import data
 	ifstream tradeData("trades.txt");
 	ifstream priceData("prices.txt");
@@ -76,6 +106,9 @@ int main()
 	marketdataservice.GetConnector()->Subscribe(marketData);
 	inquiryservice.GetConnector()->Subscribe(inquiryData);
 
+	//Scenario ladders of the final book
+	scenarioriskservice.RunScenarios();
+
 	//std::cout << marketdataservice.GetData("TMUBMUSD02Y").GetOfferStack()[2].GetPrice() << std::endl;
 	//std::cout << "end" << std::endl;
 	//Test data
@@ -9,7 +9,10 @@
 
 #include <string>
 #include <vector>
+#include <algorithm>
 #include "soa.hpp"
+#include "snapshot.hpp"
+#include "eventarena.hpp"
 
 using namespace std;
 
@@ -68,6 +71,19 @@ private:
 
 };
 
+/**
+ * Result of sweeping one side of a book for a quantity:
+ * the quantity available up to it, the number of levels reached,
+ * the price of the last level reached and the average price.
+ */
+struct DepthSweep
+{
+	long quantity;
+	int levels;
+	double limitPrice;
+	double averagePrice;
+};
+
 /**
  * Order book with a bid and offer stack.
  * Type T is the product type.
@@ -82,6 +98,9 @@ public:
 	OrderBook() {}
 	OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack);
 
+  // Set the book, reusing the memory of the stacks and depths
+	void Assign(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack);
+
   // Get the product
 	const T& GetProduct() const;
 
@@ -94,35 +113,85 @@ public:
 	//Get the best bid offer order
 	BidOffer GetBidOffer() const
 	{
-		double bid = -100;
-		double offer = 10000;
 		Order bidorder;
 		Order offerorder;
-		for (auto b = bidStack.begin(); b != bidStack.end(); b++)
-		{
-			double price = b->GetPrice();
-			if (price > bid)
-			{
-				bid = price;
-				bidorder = (*b);
-			}
-		}
-		for (auto o = bidStack.begin(); o != bidStack.end(); o++)
+		if (bestbid >= 0) bidorder = bidStack[bestbid];
+		if (bestoffer >= 0) offerorder = offerStack[bestoffer];
+		return BidOffer(bidorder, offerorder);
+	}
+
+	// Is there an order on both sides
+	bool HasBidOffer() const
+	{
+		return bestbid >= 0 && bestoffer >= 0;
+	}
+
+	// Get the best bid order, the book must have one
+	const Order& GetBestBid() const
+	{
+		return bidStack[bestbid];
+	}
+
+	// Get the best offer order, the book must have one
+	const Order& GetBestOffer() const
+	{
+		return offerStack[bestoffer];
+	}
+
+	// Sweep the levels of a side, best first, for a quantity; nothing to fill (no level, or only empty
+	// ones) gives an empty sweep, of quantity, levels and prices 0
+	DepthSweep SweepDepth(PricingSide side, long quantity) const
+	{
+		const Depth& depth = side == BID ? biddepth : offerdepth;
+		DepthSweep sweep = { 0, 0, 0.0, 0.0 };
+		size_t n = depth.prices.size();
+		if (n == 0 || quantity <= 0) return sweep;
+
+		//Branch-free lower bound: first level whose cumulative quantity reaches the target
+		const long* first = depth.quantities.data() + 1;
+		const long* base = first;
+		size_t len = n;
+		while (len > 1)
 		{
-			double price = o->GetPrice();
-			if (price <offer)
-			{
-				offer = price;
-				offerorder = (*o);
-			}
+			size_t half = len / 2;
+			base += (base[half - 1] < quantity) * half;
+			len -= half;
 		}
-		return BidOffer(bidorder, offerorder);
+		size_t level = (base - first) + (*base < quantity);
+		level = min(level, n - 1);
+
+		//Full levels before it, and the part of it needed
+		long filled = min(quantity, depth.quantities[level + 1]);
+		if (filled <= 0) return sweep;
+		double notional = depth.notionals[level] + (filled - depth.quantities[level]) * depth.prices[level];
+		sweep.quantity = filled;
+		sweep.levels = (int)level + 1;
+		sweep.limitPrice = depth.prices[level];
+		sweep.averagePrice = notional / filled;
+		return sweep;
 	}
 
 private:
   T product;
   vector<Order> bidStack;
   vector<Order> offerStack;
+  //Index of the best bid and offer in their stacks (first one at the best price), -1 if empty
+  int bestbid = -1;
+  int bestoffer = -1;
+
+  //Levels of a side sorted best first, with cumulative quantity and notional
+  //(entry i covers the levels before level i, so entry 0 is zero)
+  struct Depth
+  {
+    vector<double> prices;
+    vector<long> quantities;
+    vector<double> notionals;
+  };
+  Depth biddepth;
+  Depth offerdepth;
+
+  // Build the cumulative depth of a stack
+  static void BuildDepth(const vector<Order>& stack, bool descending, Depth& depth);
 
 };
 
@@ -134,6 +203,7 @@ class MarketDataConnector;
 
 /**
  * Market Data Service which distributes market data
+ * With snapshots enabled, the books are snapshotted every interval updates.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -145,6 +215,37 @@ private:
 	vector<ServiceListener<OrderBook<T>>*> listeners;
 	MarketDataConnector<T>* connector;
 
+	//Snapshots: writer, buffer, interval and the number of book updates
+	SnapshotWriter* snapshotwriter;
+	SnapshotBuffer snapshotbuffer;
+	unsigned long long snapshotinterval;
+	unsigned long long updatecount;
+
+	// Write the orders of a stack to the snapshot buffer
+	void PutStack(const vector<Order>& stack)
+	{
+		snapshotbuffer.Put((unsigned int)stack.size());
+		for (auto o = stack.begin(); o != stack.end(); o++)
+		{
+			snapshotbuffer.Put(o->GetPrice());
+			snapshotbuffer.Put(o->GetQuantity());
+		}
+	}
+
+	// Read the orders of a stack from a snapshot
+	static vector<Order> GetStack(SnapshotReader& reader, PricingSide side)
+	{
+		vector<Order> stack;
+		unsigned int count = reader.Get<unsigned int>();
+		for (unsigned int i = 0; i < count && reader.IsOk(); i++)
+		{
+			double price = reader.Get<double>();
+			long quantity = reader.Get<long>();
+			stack.push_back(Order(price, quantity, side));
+		}
+		return stack;
+	}
+
 public:
 	//Ctor and Dtor
 	MarketDataService()
@@ -152,8 +253,14 @@ public:
 		orderbookmap= map<string, OrderBook<T>>();
 		listeners = vector<ServiceListener<OrderBook<T>>*>();
 		connector = new MarketDataConnector<T>(this);
+		snapshotwriter = nullptr;
+		snapshotinterval = 0;
+		updatecount = 0;
+	}
+	~MarketDataService()
+	{
+		delete snapshotwriter;
 	}
-	~MarketDataService() = default;
 
 	// Get data on our service given a key
 	virtual OrderBook<T>& GetData(string key)
@@ -171,6 +278,9 @@ public:
 		{
 			(*i)->ProcessAdd(data);
 		}
+
+		updatecount++;
+		if (snapshotwriter != nullptr && updatecount % snapshotinterval == 0) TakeSnapshot();
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -191,6 +301,12 @@ public:
 		return connector;
 	}
 
+	// Allocate the transient objects of the events read by the connector in an arena, nullptr for the global heap
+	void SetArena(EventArena* arena)
+	{
+		connector->SetArena(arena);
+	}
+
   // Get the best bid/offer order
 	BidOffer GetBestBidOffer(const string& productId)
 	{
@@ -234,6 +350,60 @@ public:
 		return OrderBook<T>(product, bidnew, offernew);
 	}
 
+	// Snapshot the books to base.0 / base.1 every interval updates
+	void EnableSnapshots(const string& base, unsigned long long interval)
+	{
+		delete snapshotwriter;
+		snapshotwriter = new SnapshotWriter(base);
+		snapshotinterval = interval > 0 ? interval : 1;
+	}
+
+	// Hand the books to the snapshot writer, returns false if it is still writing the last one
+	bool TakeSnapshot()
+	{
+		if (snapshotwriter == nullptr || snapshotwriter->IsBusy()) return false;
+		snapshotbuffer.Put((unsigned int)orderbookmap.size());
+		for (auto b = orderbookmap.begin(); b != orderbookmap.end(); b++)
+		{
+			snapshotbuffer.PutString(b->first);
+			PutStack(b->second.GetBidStack());
+			PutStack(b->second.GetOfferStack());
+		}
+		return snapshotwriter->Submit(snapshotbuffer, updatecount);
+	}
+
+	// Snapshot the current state and wait until it is written
+	void FlushSnapshots()
+	{
+		if (snapshotwriter == nullptr) return;
+		snapshotwriter->Flush();
+		TakeSnapshot();
+		snapshotwriter->Flush();
+	}
+
+	// Load the books of the latest snapshot, without notifying the listeners
+	// Returns the number of updates it covers, 0 if there is none
+	unsigned long long RestoreSnapshot(const string& base)
+	{
+		vector<char> payload;
+		unsigned long long position;
+		if (!SnapshotWriter::Load(base, payload, position)) return 0;
+		SnapshotReader reader(payload);
+		map<string, OrderBook<T>> restored;
+		unsigned int count = reader.Get<unsigned int>();
+		for (unsigned int i = 0; i < count && reader.IsOk(); i++)
+		{
+			string id = reader.GetString();
+			vector<Order> bids = GetStack(reader, BID);
+			vector<Order> offers = GetStack(reader, OFFER);
+			restored[id] = OrderBook<T>(FindProduct<T>(id), bids, offers);
+		}
+		if (!reader.IsOk()) return 0;
+		orderbookmap.swap(restored);
+		updatecount = position;
+		return position;
+	}
+
 };
 
 Order::Order(double _price, long _quantity, PricingSide _side)
@@ -274,9 +444,52 @@ const Order& BidOffer::GetOfferOrder() const
 }
 
 template<typename T>
-OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack) :
-  product(_product), bidStack(_bidStack), offerStack(_offerStack)
+OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack)
+{
+  Assign(_product, _bidStack, _offerStack);
+}
+
+template<typename T>
+void OrderBook<T>::Assign(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack)
 {
+  product = _product;
+  bidStack.assign(_bidStack.begin(), _bidStack.end());
+  offerStack.assign(_offerStack.begin(), _offerStack.end());
+  bestbid = -1;
+  bestoffer = -1;
+  //Cache the best bid and offer once per book
+  for (size_t i = 0; i < bidStack.size(); i++)
+  {
+    if (bestbid < 0 || bidStack[i].GetPrice() > bidStack[bestbid].GetPrice()) bestbid = (int)i;
+  }
+  for (size_t i = 0; i < offerStack.size(); i++)
+  {
+    if (bestoffer < 0 || offerStack[i].GetPrice() < offerStack[bestoffer].GetPrice()) bestoffer = (int)i;
+  }
+  BuildDepth(bidStack, true, biddepth);
+  BuildDepth(offerStack, false, offerdepth);
+}
+
+template<typename T>
+void OrderBook<T>::BuildDepth(const vector<Order>& stack, bool descending, Depth& depth)
+{
+  //Sort a copy of the stack, held in a buffer on the stack for the few levels of a book
+  char local[32 * sizeof(Order)];
+  pmr::monotonic_buffer_resource scratch(local, sizeof(local));
+  pmr::vector<Order> levels(stack.begin(), stack.end(), &scratch);
+  StableSortSmall(levels.begin(), levels.end(), [descending](const Order& a, const Order& b)
+  {
+    return descending ? a.GetPrice() > b.GetPrice() : a.GetPrice() < b.GetPrice();
+  });
+  depth.prices.resize(levels.size());
+  depth.quantities.assign(levels.size() + 1, 0);
+  depth.notionals.assign(levels.size() + 1, 0.0);
+  for (size_t i = 0; i < levels.size(); i++)
+  {
+    depth.prices[i] = levels[i].GetPrice();
+    depth.quantities[i + 1] = depth.quantities[i] + levels[i].GetQuantity();
+    depth.notionals[i + 1] = depth.notionals[i] + levels[i].GetPrice() * levels[i].GetQuantity();
+  }
 }
 
 template<typename T>
@@ -308,6 +521,8 @@ class MarketDataConnector : public Connector<OrderBook<T>>
 private:
 	//The service it is attached to
 	MarketDataService<T>* service;
+	//Arena of the transient objects of a line, nullptr for the global heap
+	EventArena* arena = nullptr;
 public:
 	//Ctor and Dtor
 	MarketDataConnector() {}
@@ -317,6 +532,12 @@ public:
 	}
 	~MarketDataConnector() = default;
 
+	// Allocate the transient objects of the lines read in an arena, nullptr for the global heap
+	void SetArena(EventArena* a)
+	{
+		arena = a;
+	}
+
 	//Publisher
 	void Publish(OrderBook<T>& data) {}
 
@@ -324,13 +545,17 @@ public:
 	void Subscribe(ifstream& data)
 	{
 		string line;
+		//Orders of the book being read and the book, reused from book to book
 		vector<Order> bids, offers;
+		OrderBook<T> odb;
 		int count=0;
 		int depth = 10;
 		while (getline(data, line))
 		{
-			string ele = "";
-			vector<string> elements;
+			EventScope scope(arena);
+			pmr::memory_resource* resource = ArenaResource(arena);
+			pmr::string ele(resource);
+			pmr::vector<pmr::string> elements(resource);
 			for (int i = 0; i < line.size(); i++)
 			{
 				if (line[i] == ',')
@@ -344,9 +569,9 @@ public:
 				}
 			}
 			elements.push_back(ele);
-			string cusip = elements[0];
+			string cusip(elements[0]);
 			double price = FractionaltoPrice(elements[1]);
-			long quantity = stol(elements[2]);
+			long quantity = strtol(elements[2].c_str(), nullptr, 10);
 			PricingSide side = BID;
 			if (elements[3] == "OFFER") side = OFFER;
 			Order order(price, quantity, side);
@@ -363,10 +588,10 @@ public:
 			{
 				count = 0;
 				T product = MakeBond(cusip);
-				OrderBook<T> odb(product, bids, offers);
+				odb.Assign(product, bids, offers);
 				service->OnMessage(odb);
-				bids = vector<Order>();
-				offers = vector<Order>();
+				bids.clear();
+				offers.clear();
 			}
 		}
 	}
@@ -0,0 +1,267 @@
+/*
+* orderstore.hpp
+* Store of open orders keyed by order id
+* Author: Tengxiao Fan
+*/
+
+#ifndef ORDERSTORE_HPP
+#define ORDERSTORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+
+using namespace std;
+
+// Lifecycle states of an order
+enum OrderState { NEW, PARTIAL, FILLED, CANCELLED };
+
+/*
+* Record of an open order
+*/
+struct OrderRecord
+{
+	unsigned long long orderId;
+	int product;
+	PricingSide side;
+	OrderType type;
+	OrderState state;
+	double price;
+	long quantity;
+	long filled;
+	//Intrusive list of the open orders of the product
+	int prev;
+	int next;
+};
+
+/*
+* Store of open orders.
+* Records live in a pooled arena and are found by order id through an open-addressing
+* hash table (linear probing, backward-shift deletion), so every update is O(1).
+* Open orders of a product are linked in an intrusive list.
+* Orders are dropped once FILLED or CANCELLED, so memory is bounded by the open orders.
+*/
+class OrderStore
+{
+private:
+	//Arena of records and its free slots
+	vector<OrderRecord> records;
+	vector<int> freerecords;
+
+	//Hash table of order id to record, 0 marks an empty bucket
+	vector<unsigned long long> keys;
+	vector<int> values;
+	size_t count;
+
+	//Products and the head of their open order lists
+	map<string, int> productslots;
+	vector<string> productids;
+	vector<int> heads;
+
+	static size_t Hash(unsigned long long key)
+	{
+		key ^= key >> 33;
+		key *= 0xff51afd7ed558ccdULL;
+		key ^= key >> 33;
+		return (size_t)key;
+	}
+
+	// Find the bucket of a key, or the empty bucket where it would go
+	size_t Bucket(unsigned long long key) const
+	{
+		size_t mask = keys.size() - 1;
+		size_t i = Hash(key) & mask;
+		while (keys[i] != 0 && keys[i] != key) i = (i + 1) & mask;
+		return i;
+	}
+
+	// Double the hash table
+	void Grow()
+	{
+		vector<unsigned long long> oldkeys = keys;
+		vector<int> oldvalues = values;
+		keys = vector<unsigned long long>(oldkeys.size() * 2, 0);
+		values = vector<int>(oldvalues.size() * 2, -1);
+		for (size_t i = 0; i < oldkeys.size(); i++)
+		{
+			if (oldkeys[i] == 0) continue;
+			size_t b = Bucket(oldkeys[i]);
+			keys[b] = oldkeys[i];
+			values[b] = oldvalues[i];
+		}
+	}
+
+	// Remove a key, shifting back the entries that probed past it
+	void Erase(unsigned long long key)
+	{
+		size_t mask = keys.size() - 1;
+		size_t i = Bucket(key);
+		if (keys[i] == 0) return;
+		size_t j = i;
+		while (true)
+		{
+			j = (j + 1) & mask;
+			if (keys[j] == 0) break;
+			size_t home = Hash(keys[j]) & mask;
+			//Move j back to i if its home is not cyclically in (i, j]
+			if ((j > i && (home <= i || home > j)) || (j < i && (home <= i && home > j)))
+			{
+				keys[i] = keys[j];
+				values[i] = values[j];
+				i = j;
+			}
+		}
+		keys[i] = 0;
+		values[i] = -1;
+		count--;
+	}
+
+	// Get the slot of a product
+	int ProductSlot(const string& productId)
+	{
+		auto it = productslots.find(productId);
+		if (it != productslots.end()) return it->second;
+		int slot = (int)productids.size();
+		productslots[productId] = slot;
+		productids.push_back(productId);
+		heads.push_back(-1);
+		return slot;
+	}
+
+	// Unlink a record from its product list and release it
+	void Release(int r)
+	{
+		OrderRecord& record = records[r];
+		if (record.prev >= 0) records[record.prev].next = record.next;
+		else heads[record.product] = record.next;
+		if (record.next >= 0) records[record.next].prev = record.prev;
+		Erase(record.orderId);
+		freerecords.push_back(r);
+	}
+
+public:
+	//Ctor and Dtor
+	OrderStore()
+	{
+		keys = vector<unsigned long long>(1024, 0);
+		values = vector<int>(1024, -1);
+		count = 0;
+	}
+	~OrderStore() = default;
+
+	// Add a new order, returns false if the id is already open
+	bool Add(unsigned long long orderId, const string& productId, PricingSide side, OrderType type, double price, long quantity)
+	{
+		if (orderId == 0 || Find(orderId) != nullptr) return false;
+		if ((count + 1) * 2 > keys.size()) Grow();
+
+		int r;
+		if (!freerecords.empty())
+		{
+			r = freerecords.back();
+			freerecords.pop_back();
+		}
+		else
+		{
+			r = (int)records.size();
+			records.push_back(OrderRecord());
+		}
+		int product = ProductSlot(productId);
+		OrderRecord& record = records[r];
+		record.orderId = orderId;
+		record.product = product;
+		record.side = side;
+		record.type = type;
+		record.state = NEW;
+		record.price = price;
+		record.quantity = quantity;
+		record.filled = 0;
+		record.prev = -1;
+		record.next = heads[product];
+		if (record.next >= 0) records[record.next].prev = r;
+		heads[product] = r;
+
+		size_t b = Bucket(orderId);
+		keys[b] = orderId;
+		values[b] = r;
+		count++;
+		return true;
+	}
+
+	// Find an open order, nullptr if it is not open
+	const OrderRecord* Find(unsigned long long orderId) const
+	{
+		size_t b = Bucket(orderId);
+		if (keys[b] == 0) return nullptr;
+		return &records[values[b]];
+	}
+
+	// Apply a fill to an order, returns its new state
+	OrderState Fill(unsigned long long orderId, long quantity)
+	{
+		size_t b = Bucket(orderId);
+		if (keys[b] == 0) return FILLED;
+		int r = values[b];
+		OrderRecord& record = records[r];
+		record.filled += quantity;
+		if (record.filled >= record.quantity)
+		{
+			Release(r);
+			return FILLED;
+		}
+		record.state = PARTIAL;
+		return PARTIAL;
+	}
+
+	// Cancel an order, returns false if it is not open
+	bool Cancel(unsigned long long orderId)
+	{
+		size_t b = Bucket(orderId);
+		if (keys[b] == 0) return false;
+		Release(values[b]);
+		return true;
+	}
+
+	// Amend the price and total quantity of an order, returns false if it is not open
+	// An order amended down to its filled quantity is complete
+	bool Amend(unsigned long long orderId, double price, long quantity)
+	{
+		size_t b = Bucket(orderId);
+		if (keys[b] == 0) return false;
+		int r = values[b];
+		OrderRecord& record = records[r];
+		record.price = price;
+		record.quantity = quantity;
+		if (record.filled >= record.quantity) Release(r);
+		return true;
+	}
+
+	// Get the product id of a product slot
+	const string& GetProductId(int product) const
+	{
+		return productids[product];
+	}
+
+	// Get the open orders of a product
+	vector<OrderRecord> GetOpenOrders(const string& productId) const
+	{
+		vector<OrderRecord> result;
+		auto it = productslots.find(productId);
+		if (it == productslots.end()) return result;
+		for (int r = heads[it->second]; r >= 0; r = records[r].next)
+		{
+			result.push_back(records[r]);
+		}
+		return result;
+	}
+
+	// Get the number of open orders
+	size_t GetOpenCount() const
+	{
+		return count;
+	}
+};
+
+#endif // !ORDERSTORE_HPP
@@ -0,0 +1,357 @@
+/**
+ * pnlservice.hpp
+ * Defines the data types and Service for real-time P&L.
+ *
+ * @author Tengxiao Fan
+ */
+#ifndef PNL_SERVICE_HPP
+#define PNL_SERVICE_HPP
+
+#include <string>
+#include <unordered_map>
+#include "soa.hpp"
+#include "tradebookingservice.hpp"
+#include "pricingservice.hpp"
+
+/**
+ * P&L of a product in a book (or across all books with book TOTAL).
+ * Prices are per 100 face, P&L is in currency.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnL
+{
+
+public:
+
+  // ctor for a P&L value
+	PnL() {}
+	PnL(const T& _product, string _book, long _position, double _averageCost, double _mark, double _realized, double _unrealized) :
+		product(_product), book(_book), position(_position), averageCost(_averageCost), mark(_mark), realized(_realized), unrealized(_unrealized) {}
+
+  // Get the product
+	const T& GetProduct() const
+	{
+		return product;
+	}
+
+  // Get the book
+	const string& GetBook() const
+	{
+		return book;
+	}
+
+  // Get the position
+	long GetPosition() const
+	{
+		return position;
+	}
+
+  // Get the average cost of the position
+	double GetAverageCost() const
+	{
+		return averageCost;
+	}
+
+  // Get the mark price
+	double GetMark() const
+	{
+		return mark;
+	}
+
+  // Get the realized P&L
+	double GetRealized() const
+	{
+		return realized;
+	}
+
+  // Get the unrealized P&L
+	double GetUnrealized() const
+	{
+		return unrealized;
+	}
+
+  // Get the total P&L
+	double GetTotal() const
+	{
+		return realized + unrealized;
+	}
+
+	//Output function
+	ostream& Output(ostream& file)
+	{
+		file << GetProduct().GetProductId() << "," << GetBook() << "," << GetPosition() << "," << GetAverageCost() << "," << GetMark() << "," << GetRealized() << "," << GetUnrealized() << endl;
+		return file;
+	}
+
+private:
+  T product;
+  string book;
+  long position;
+  double averageCost;
+  double mark;
+  double realized;
+  double unrealized;
+
+};
+
+/*
+* Pre declarations of the listeners
+*/
+template<typename T>
+class PnLTradeBookingListener;
+template<typename T>
+class PnLPricingListener;
+
+/**
+ * P&L Service tracking realized P&L and average cost per product and book from trades,
+ * and marking unrealized P&L on every price tick.
+ * Trades are published with ProcessAdd and price marks with ProcessUpdate.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class PnLService : public Service<string, PnL<T> >
+{
+private:
+	//Running state of a book
+	struct BookState
+	{
+		long position = 0;
+		double averageCost = 0;
+		double realized = 0;
+	};
+
+	//Running state of a product, aggregated across its books
+	struct ProductState
+	{
+		T product;
+		map<string, BookState> books;
+		long position = 0;
+		double costBasis = 0;
+		double realized = 0;
+		double mark = 0;
+		bool marked = false;
+		double unrealized = 0;
+		PnL<T> pnl;
+	};
+
+	unordered_map<string, ProductState> states;
+	vector<ServiceListener<PnL<T>>*> listeners;
+	PnLTradeBookingListener<T>* tradebooking_listener;
+	PnLPricingListener<T>* pricing_listener;
+	double totalRealized;
+	double totalUnrealized;
+
+public:
+	//Ctor and Dtor
+	PnLService()
+	{
+		states = unordered_map<string, ProductState>();
+		listeners = vector<ServiceListener<PnL<T>>*>();
+		tradebooking_listener = new PnLTradeBookingListener<T>(this);
+		pricing_listener = new PnLPricingListener<T>(this);
+		totalRealized = 0;
+		totalUnrealized = 0;
+	}
+	~PnLService() = default;
+
+	// Get data on our service given a key
+	virtual PnL<T>& GetData(string key)
+	{
+		return states[key].pnl;
+	}
+
+	// The callback that a Connector should invoke for any new or updated data
+	virtual void OnMessage(PnL<T>& data)
+	{
+		string key = data.GetProduct().GetProductId();
+		states[key].pnl = data;
+		//Call all the listeners
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(data);
+		}
+	}
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	virtual void AddListener(ServiceListener<PnL<T>>* listener)
+	{
+		listeners.push_back(listener);
+	}
+
+	// Get all listeners on the Service
+	virtual const vector<ServiceListener<PnL<T>>*>& GetListeners() const
+	{
+		return listeners;
+	}
+
+	// Get the listener to the trade booking service
+	PnLTradeBookingListener<T>* GetTradeBookingListener()
+	{
+		return tradebooking_listener;
+	}
+
+	// Get the listener to the pricing service
+	PnLPricingListener<T>* GetPricingListener()
+	{
+		return pricing_listener;
+	}
+
+	// Get the realized P&L across all products
+	double GetTotalRealized() const
+	{
+		return totalRealized;
+	}
+
+	// Get the unrealized P&L across all products
+	double GetTotalUnrealized() const
+	{
+		return totalUnrealized;
+	}
+
+	// Get the P&L of a product in a book
+	PnL<T> GetBookPnL(const string& productId, const string& book)
+	{
+		ProductState& state = states[productId];
+		BookState& b = state.books[book];
+		double unrealized = state.marked ? b.position * (state.mark - b.averageCost) / 100.0 : 0.0;
+		return PnL<T>(state.product, book, b.position, b.averageCost, state.mark, b.realized, unrealized);
+	}
+
+	// Book a trade: update the average cost and realized P&L of its book
+	void AddTrade(const Trade<T>& trade)
+	{
+		const T& product = trade.GetProduct();
+		ProductState& state = states[product.GetProductId()];
+		state.product = product;
+		BookState& b = state.books[trade.GetBook()];
+
+		long quantity = trade.GetSide() == BUY ? trade.GetQuantity() : -trade.GetQuantity();
+		double price = trade.GetPrice();
+		long oldposition = b.position;
+		double oldcost = oldposition * b.averageCost;
+		double oldrealized = b.realized;
+
+		if (oldposition == 0 || (oldposition > 0) == (quantity > 0))
+		{
+			//Increasing the position: blend the average cost
+			b.averageCost = (b.averageCost * labs(oldposition) + price * labs(quantity)) / (labs(oldposition) + labs(quantity));
+			b.position += quantity;
+		}
+		else
+		{
+			//Reducing the position: realize against the average cost
+			long closed = min(labs(quantity), labs(oldposition));
+			double sign = oldposition > 0 ? 1.0 : -1.0;
+			b.realized += closed * (price - b.averageCost) * sign / 100.0;
+			b.position += quantity;
+			if (b.position == 0) b.averageCost = 0;
+			else if ((b.position > 0) != (oldposition > 0)) b.averageCost = price;
+		}
+
+		state.position += b.position - oldposition;
+		state.costBasis += b.position * b.averageCost - oldcost;
+		state.realized += b.realized - oldrealized;
+		totalRealized += b.realized - oldrealized;
+		Mark(state);
+
+		PnL<T> bookpnl = GetBookPnL(product.GetProductId(), trade.GetBook());
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(bookpnl);
+		}
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(state.pnl);
+		}
+	}
+
+	// Mark a product to a new mid, constant work per tick
+	void MarkPrice(const Price<T>& price)
+	{
+		const T& product = price.GetProduct();
+		ProductState& state = states[product.GetProductId()];
+		if (!state.marked) state.product = product;
+		state.mark = price.GetMid();
+		state.marked = true;
+		Mark(state);
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessUpdate(state.pnl);
+		}
+	}
+
+private:
+	// Recompute the unrealized P&L of a product and the running total
+	void Mark(ProductState& state)
+	{
+		double unrealized = state.marked ? (state.position * state.mark - state.costBasis) / 100.0 : 0.0;
+		totalUnrealized += unrealized - state.unrealized;
+		state.unrealized = unrealized;
+		double averagecost = state.position != 0 ? state.costBasis / state.position : 0.0;
+		state.pnl = PnL<T>(state.product, "TOTAL", state.position, averagecost, state.mark, state.realized, unrealized);
+	}
+};
+
+/*
+* P&L listener to the trade booking service
+*/
+template<typename T>
+class PnLTradeBookingListener : public ServiceListener<Trade<T>>
+{
+private:
+	PnLService<T>* service;
+
+public:
+	//Ctor and Dtor
+	PnLTradeBookingListener(PnLService<T>* s)
+	{
+		service = s;
+	}
+	~PnLTradeBookingListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Trade<T>& data)
+	{
+		service->AddTrade(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Trade<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Trade<T>& data){}
+};
+
+/*
+* P&L listener to the pricing service
+*/
+template<typename T>
+class PnLPricingListener : public ServiceListener<Price<T>>
+{
+private:
+	PnLService<T>* service;
+
+public:
+	//Ctor and Dtor
+	PnLPricingListener(PnLService<T>* s)
+	{
+		service = s;
+	}
+	~PnLPricingListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Price<T>& data)
+	{
+		service->MarkPrice(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Price<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Price<T>& data){}
+};
+
+#endif
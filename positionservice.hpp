@@ -11,6 +11,9 @@
 #include <map>
 #include "soa.hpp"
 #include "tradebookingservice.hpp"
+#include "snapshot.hpp"
+#include "columnarstore.hpp"
+#include "serializer.hpp"
 
 using namespace std;
 
@@ -42,16 +45,18 @@ public:
 
   // Get the aggregate position
   long GetAggregatePosition();
+
+  // Get the positions of all books
+  const map<string, long>& GetPositions() const
+  {
+	  return positions;
+  }
   T product;
 
   //Output function
   ostream& Output(ostream& file)
   {
-	  string trsy1 = "TRSY1";
-	  string trsy2 = "TRSY2";
-	  string trsy3 = "TRSY3";
-	  file << GetProduct().GetProductId() << ",TRSY1," << GetPosition(trsy1) << ",TRSY2," << GetPosition(trsy2) << ",TRSY3," << GetPosition(trsy3) << ",TOTAL," << GetAggregatePosition() << endl;
-	  return file;
+	  return Serialize(file, *this);
   }
 
 private:
@@ -91,6 +96,74 @@ long Position<T>::GetAggregatePosition()
 }
 
 
+/*
+* CSV line of a position: the product, the three books and the total
+*/
+template<typename T>
+struct SerializerTraits<Position<T>>
+{
+	static const bool Defined = true;
+	static size_t MaxSize(const Position<T>& data)
+	{
+		return data.GetProduct().GetProductId().size() + 4 * (7 + LongTextSize) + 1;
+	}
+	static size_t Write(const Position<T>& data, char* buf)
+	{
+		static const char* const books[] = { "TRSY1", "TRSY2", "TRSY3" };
+		//One pass over the books for the three quantities and the total
+		const map<string, long>& positions = data.GetPositions();
+		long quantities[3] = { 0, 0, 0 };
+		long total = 0;
+		for (auto it = positions.begin(); it != positions.end(); it++)
+		{
+			total += it->second;
+			if (it->first.size() != 5 || it->first.compare(0, 4, "TRSY") != 0) continue;
+			int b = it->first[4] - '1';
+			if (b >= 0 && b < 3) quantities[b] = it->second;
+		}
+		char* p = buf + WriteText(buf, data.GetProduct().GetProductId());
+		for (int b = 0; b < 3; b++)
+		{
+			*p++ = ',';
+			p += WriteText(p, books[b], 5);
+			*p++ = ',';
+			p += WriteLong(p, quantities[b]);
+		}
+		p += WriteText(p, ",TOTAL,", 7);
+		p += WriteLong(p, total);
+		*p++ = '\n';
+		return p - buf;
+	}
+};
+
+/*
+* Columns of a position, one row per book
+*/
+template<typename T>
+struct ColumnarTraits<Position<T>>
+{
+	static const int Columns = 4;
+	static const ColumnSpec* GetColumns()
+	{
+		static const ColumnSpec columns[] = { { "timestamp", COLUMN_INT64 }, { "product", COLUMN_STRING }, { "book", COLUMN_STRING }, { "quantity", COLUMN_INT64 } };
+		return columns;
+	}
+	template<typename W>
+	static void Write(W& writer, long long timestamp, const Position<T>& data)
+	{
+		ColumnCell row[Columns];
+		row[0].i = timestamp;
+		row[1].i = writer.Code(data.GetProduct().GetProductId());
+		const map<string, long>& books = data.GetPositions();
+		for (auto b = books.begin(); b != books.end(); b++)
+		{
+			row[2].i = writer.Code(b->first);
+			row[3].i = b->second;
+			writer.AppendRow(row);
+		}
+	}
+};
+
 /*
 * Pre declaration for the listener
 */
@@ -100,6 +173,10 @@ class PositionTradeBookingListener;
 
 /**
  * Position Service to manage positions across multiple books and secruties.
+ * With snapshots enabled, the positions are snapshotted every interval trades; the position of a
+ * snapshot is the number of trades it covers, from where the trade journal is replayed on restart.
+ * Given the trade journal, it is committed before each snapshot, so a snapshot never covers
+ * trades the journal could still lose.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -111,6 +188,12 @@ private:
 	vector<ServiceListener<Position<T>>*> listeners;
 	PositionTradeBookingListener<T>* tradebooking_listener;
 
+	//Snapshots: writer, buffer, interval and the number of trades booked
+	SnapshotWriter* snapshotwriter;
+	SnapshotBuffer snapshotbuffer;
+	unsigned long long snapshotinterval;
+	unsigned long long tradecount;
+	Journal<TradeRecord>* snapshotjournal;
 
 public:
 	// Constructor and destructor
@@ -119,9 +202,15 @@ public:
 		positions = map<string, Position<T>>();
 		listeners = vector<ServiceListener<Position<T>>*>();
 		tradebooking_listener = new PositionTradeBookingListener<T>(this);
-
+		snapshotwriter = nullptr;
+		snapshotinterval = 0;
+		tradecount = 0;
+		snapshotjournal = nullptr;
+	}
+	~PositionService()
+	{
+		delete snapshotwriter;
 	}
-	~PositionService()=default;
 
 	// Get data on our service given a key
 	virtual Position<T>& GetData(string key)
@@ -162,32 +251,108 @@ public:
 	//Update the position
 	virtual void AddTrade(const Trade<T>& trade)
 	{
-		T product = trade.GetProduct();
-		string id = product.GetProductId();
-		double price = trade.GetPrice();
-		string book = trade.GetBook();
+		const T& product = trade.GetProduct();
+		//Update the position in place
+		Position<T>& position = positions[product.GetProductId()];
+		position.product = product;
 		long quantity = trade.GetQuantity();
-		Side side = trade.GetSide();
-		//Position<T> newposition(product);
-		Position<T> newposition = positions[id];
-		newposition.product = product;
-		//cout << newposition.GetProduct().GetProductId() << endl;
-		if (side == BUY)
+		string book = trade.GetBook();
+		if (trade.GetSide() == BUY)
 		{
-			newposition.ModifyPosition(book,quantity);
+			position.ModifyPosition(book, quantity);
 		}
 		else
 		{
-			newposition.ModifyPosition(book, -quantity);
+			position.ModifyPosition(book, -quantity);
 		}
-		
-		positions[id] = newposition;
-		//cout << id << endl;
-		//cout << positions[id].GetAggregatePosition() << std::endl;
+
 		for (auto i = listeners.begin(); i != listeners.end(); i++)
 		{
-			(*i)->ProcessAdd(newposition);
+			(*i)->ProcessAdd(position);
+		}
+
+		tradecount++;
+		if (snapshotwriter != nullptr && tradecount % snapshotinterval == 0) TakeSnapshot();
+	}
+
+	// Get the number of trades booked (restored ones included)
+	unsigned long long GetTradeCount() const
+	{
+		return tradecount;
+	}
+
+	// Get the positions of every product
+	const map<string, Position<T>>& GetAllPositions() const
+	{
+		return positions;
+	}
+
+	// Snapshot the positions to base.0 / base.1 every interval trades, committing the trade journal
+	// (owned by the trade booking service) first if there is one
+	void EnableSnapshots(const string& base, unsigned long long interval, Journal<TradeRecord>* journal = nullptr)
+	{
+		delete snapshotwriter;
+		snapshotwriter = new SnapshotWriter(base);
+		snapshotinterval = interval > 0 ? interval : 1;
+		snapshotjournal = journal;
+	}
+
+	// Hand the positions to the snapshot writer, returns false if it is still writing the last one
+	// or the journal could not be committed
+	bool TakeSnapshot()
+	{
+		if (snapshotwriter == nullptr || snapshotwriter->IsBusy()) return false;
+		if (snapshotjournal != nullptr && !snapshotjournal->Commit()) return false;
+		snapshotbuffer.Put((unsigned int)positions.size());
+		for (auto p = positions.begin(); p != positions.end(); p++)
+		{
+			const map<string, long>& books = p->second.GetPositions();
+			snapshotbuffer.PutString(p->first);
+			snapshotbuffer.Put((unsigned int)books.size());
+			for (auto b = books.begin(); b != books.end(); b++)
+			{
+				snapshotbuffer.PutString(b->first);
+				snapshotbuffer.Put(b->second);
+			}
+		}
+		return snapshotwriter->Submit(snapshotbuffer, tradecount);
+	}
+
+	// Snapshot the current state and wait until it is written
+	void FlushSnapshots()
+	{
+		if (snapshotwriter == nullptr) return;
+		snapshotwriter->Flush();
+		TakeSnapshot();
+		snapshotwriter->Flush();
+	}
+
+	// Load the positions of the latest snapshot, without notifying the listeners
+	// Returns the number of trades it covers, 0 if there is none
+	unsigned long long RestoreSnapshot(const string& base)
+	{
+		vector<char> payload;
+		unsigned long long position;
+		if (!SnapshotWriter::Load(base, payload, position)) return 0;
+		SnapshotReader reader(payload);
+		map<string, Position<T>> restored;
+		unsigned int count = reader.Get<unsigned int>();
+		for (unsigned int i = 0; i < count && reader.IsOk(); i++)
+		{
+			string id = reader.GetString();
+			Position<T>& p = restored[id];
+			p.product = FindProduct<T>(id);
+			unsigned int books = reader.Get<unsigned int>();
+			for (unsigned int b = 0; b < books && reader.IsOk(); b++)
+			{
+				string book = reader.GetString();
+				p.ModifyPosition(book, reader.Get<long>());
+			}
 		}
+		if (!reader.IsOk()) return 0;
+		positions.swap(restored);
+		tradecount = position;
+		return position;
 	}
 };
 
@@ -8,7 +8,10 @@
 #define PRICING_SERVICE_HPP
 
 #include <string>
+#include <atomic>
 #include "soa.hpp"
+#include "snapshot.hpp"
+#include "eventarena.hpp"
 
 /**
  * A price object consisting of mid and bid/offer spread.
@@ -66,6 +69,105 @@ double Price<T>::GetBidOfferSpread() const
   return bidOfferSpread;
 }
 
+/*
+* Latest mid and spread of each product, readable from any thread without locks.
+* Each entry is a seqlock: the writer makes the sequence odd while it writes,
+* and readers retry until they see the same even sequence before and after reading.
+* Products are appended (never removed) up to a fixed capacity and found by a scan,
+* which stays short for a book of benchmark bonds.
+* There is a single writer, the pricing service.
+*/
+class PriceSnapshots
+{
+public:
+	static const int Capacity = 256;
+
+private:
+	struct Entry
+	{
+		atomic<unsigned> sequence;
+		atomic<double> mid;
+		atomic<double> spread;
+	};
+
+	Entry entries[Capacity];
+	string ids[Capacity];
+	atomic<int> count;
+
+public:
+	//Ctor and Dtor
+	PriceSnapshots()
+	{
+		for (int i = 0; i < Capacity; i++)
+		{
+			entries[i].sequence.store(0, memory_order_relaxed);
+			entries[i].mid.store(0.0, memory_order_relaxed);
+			entries[i].spread.store(0.0, memory_order_relaxed);
+		}
+		count.store(0, memory_order_relaxed);
+	}
+	~PriceSnapshots() = default;
+	PriceSnapshots(const PriceSnapshots&) = delete;
+	PriceSnapshots& operator=(const PriceSnapshots&) = delete;
+
+	// Find the slot of a product, -1 if it has no price yet
+	int Find(const string& productId) const
+	{
+		int n = count.load(memory_order_acquire);
+		for (int i = 0; i < n; i++)
+		{
+			if (ids[i] == productId) return i;
+		}
+		return -1;
+	}
+
+	// Publish the price of a product (writer only), returns false when full
+	bool Write(const string& productId, double mid, double spread)
+	{
+		int slot = Find(productId);
+		if (slot < 0)
+		{
+			slot = count.load(memory_order_relaxed);
+			if (slot == Capacity) return false;
+			ids[slot] = productId;
+		}
+		Entry& entry = entries[slot];
+		unsigned sequence = entry.sequence.load(memory_order_relaxed);
+		entry.sequence.store(sequence + 1, memory_order_relaxed);
+		atomic_thread_fence(memory_order_release);
+		entry.mid.store(mid, memory_order_relaxed);
+		entry.spread.store(spread, memory_order_relaxed);
+		entry.sequence.store(sequence + 2, memory_order_release);
+		//A new product becomes visible once its first price is written
+		if (slot == count.load(memory_order_relaxed)) count.store(slot + 1, memory_order_release);
+		return true;
+	}
+
+	// Read a consistent mid and spread of a slot
+	void Read(int slot, double& mid, double& spread) const
+	{
+		const Entry& entry = entries[slot];
+		while (true)
+		{
+			unsigned before = entry.sequence.load(memory_order_acquire);
+			mid = entry.mid.load(memory_order_relaxed);
+			spread = entry.spread.load(memory_order_relaxed);
+			atomic_thread_fence(memory_order_acquire);
+			unsigned after = entry.sequence.load(memory_order_relaxed);
+			if (before == after && (before & 1) == 0) return;
+		}
+	}
+
+	// Read the mid and spread of a product, returns false if it has no price yet
+	bool Read(const string& productId, double& mid, double& spread) const
+	{
+		int slot = Find(productId);
+		if (slot < 0) return false;
+		Read(slot, mid, spread);
+		return true;
+	}
+};
+
 /*
 * Pre-definition of a pricing connector
 */
@@ -74,6 +176,7 @@ class PricingConnector;
 
 /**
  * Pricing Service managing mid prices and bid/offers.
+ * With snapshots enabled, the prices are snapshotted every interval updates.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -85,16 +188,33 @@ private:
 	map<string, Price<T>> prices;
 	vector <ServiceListener<Price<T>>*> listeners;
 	PricingConnector<T>* connector;
+	//Latest prices for readers on other threads
+	PriceSnapshots* snapshots;
+	//Snapshots to disk: writer, buffer, interval and the number of price updates
+	SnapshotWriter* snapshotwriter;
+	SnapshotBuffer snapshotbuffer;
+	unsigned long long snapshotinterval;
+	unsigned long long updatecount;
 	
 public:
-	//Ctor and Dtor (default)
+	//Ctor and Dtor
 	PricingService()
 	{
 		prices = map<string, Price<T>>();
 		listeners = vector<ServiceListener<Price<T>>*>();
 		connector = new PricingConnector<T>(this);
+		snapshots = new PriceSnapshots();
+		snapshotwriter = nullptr;
+		snapshotinterval = 0;
+		updatecount = 0;
+	}
+	~PricingService()
+	{
+		delete snapshots;
+		delete snapshotwriter;
 	}
-	~PricingService() = default;
+	PricingService(const PricingService&) = delete;
+	PricingService& operator=(const PricingService&) = delete;
 
 	//Get the price of a key
 	virtual Price<T>& GetData(string key)
@@ -108,12 +228,16 @@ public:
 		//renew the price in the map
 		string key = data.GetProduct().GetProductId();
 		prices[key] = data;
+		snapshots->Write(key, data.GetMid(), data.GetBidOfferSpread());
 
 		//Add the process to all the listeners
 		for (auto i = listeners.begin(); i != listeners.end(); i++)
 		{
 			(*i)->ProcessAdd(data);
 		}
+
+		updatecount++;
+		if (snapshotwriter != nullptr && updatecount % snapshotinterval == 0) TakeSnapshot();
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
@@ -134,6 +258,76 @@ public:
 		return connector;
 	}
 
+	// Allocate the transient objects of the events read by the connector in an arena, nullptr for the global heap
+	void SetArena(EventArena* arena)
+	{
+		connector->SetArena(arena);
+	}
+
+	//Get the lock-free snapshot of the latest prices
+	const PriceSnapshots& GetSnapshots() const
+	{
+		return *snapshots;
+	}
+
+	// Snapshot the prices to base.0 / base.1 every interval updates
+	void EnableSnapshots(const string& base, unsigned long long interval)
+	{
+		delete snapshotwriter;
+		snapshotwriter = new SnapshotWriter(base);
+		snapshotinterval = interval > 0 ? interval : 1;
+	}
+
+	// Hand the prices to the snapshot writer, returns false if it is still writing the last one
+	bool TakeSnapshot()
+	{
+		if (snapshotwriter == nullptr || snapshotwriter->IsBusy()) return false;
+		snapshotbuffer.Put((unsigned int)prices.size());
+		for (auto p = prices.begin(); p != prices.end(); p++)
+		{
+			snapshotbuffer.PutString(p->first);
+			snapshotbuffer.Put(p->second.GetMid());
+			snapshotbuffer.Put(p->second.GetBidOfferSpread());
+		}
+		return snapshotwriter->Submit(snapshotbuffer, updatecount);
+	}
+
+	// Snapshot the current state and wait until it is written
+	void FlushSnapshots()
+	{
+		if (snapshotwriter == nullptr) return;
+		snapshotwriter->Flush();
+		TakeSnapshot();
+		snapshotwriter->Flush();
+	}
+
+	// Load the prices of the latest snapshot, without notifying the listeners
+	// Returns the number of updates it covers, 0 if there is none
+	unsigned long long RestoreSnapshot(const string& base)
+	{
+		vector<char> payload;
+		unsigned long long position;
+		if (!SnapshotWriter::Load(base, payload, position)) return 0;
+		SnapshotReader reader(payload);
+		map<string, Price<T>> restored;
+		unsigned int count = reader.Get<unsigned int>();
+		for (unsigned int i = 0; i < count && reader.IsOk(); i++)
+		{
+			string id = reader.GetString();
+			double mid = reader.Get<double>();
+			double spread = reader.Get<double>();
+			restored[id] = Price<T>(FindProduct<T>(id), mid, spread);
+		}
+		if (!reader.IsOk()) return 0;
+		prices.swap(restored);
+		for (auto p = prices.begin(); p != prices.end(); p++)
+		{
+			snapshots->Write(p->first, p->second.GetMid(), p->second.GetBidOfferSpread());
+		}
+		updatecount = position;
+		return position;
+	}
+
 };
 
 
@@ -147,6 +341,8 @@ class PricingConnector : public Connector<Price<T>>
 private:
 	PricingService<T>* service;
 	string file_name;
+	//Arena of the transient objects of a line, nullptr for the global heap
+	EventArena* arena;
 
 public:
 	//Ctor and Dtor
@@ -154,9 +350,16 @@ public:
 	{
 		//file_name = f;
 		service = s;
+		arena = nullptr;
 	}
 	~PricingConnector()=default;
 
+	// Allocate the transient objects of the events read in an arena, nullptr for the global heap
+	void SetArena(EventArena* a)
+	{
+		arena = a;
+	}
+
 	//Publish data (Nothing to realize)
 	void Publish(Price<T>& data) {}
 
@@ -167,8 +370,10 @@ public:
 		
 		while (getline(data, line))
 		{
-			string ele = "";
-			vector<string> elements;
+			EventScope scope(arena);
+			pmr::memory_resource* resource = ArenaResource(arena);
+			pmr::string ele(resource);
+			pmr::vector<pmr::string> elements(resource);
 			for (int i = 0; i < line.size(); i++)
 			{
 				if (line[i] == ',')
@@ -183,7 +388,7 @@ public:
 			}
 			elements.push_back(ele);
 			//std::cout << elements[2] << endl;
-			string cusip = elements[0];
+			string cusip(elements[0]);
 			double bid = FractionaltoPrice(elements[1]);
 			double offer = FractionaltoPrice(elements[2]);
 			double mid = (bid + offer) / 2;
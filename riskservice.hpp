@@ -9,6 +9,8 @@
 
 #include "soa.hpp"
 #include "positionservice.hpp"
+#include "columnarstore.hpp"
+#include "serializer.hpp"
 
 /**
  * PV01 risk.
@@ -44,8 +46,7 @@ public:
 
   ostream& Output(ostream& file)
   {
-	  file << GetProduct().GetProductId() << "," << GetPV01() << "," << GetQuantity() << endl;
-	  return file;
+	  return Serialize(file, *this);
   }
 
 private:
@@ -55,6 +56,53 @@ private:
 
 };
 
+/*
+* CSV line of a PV01 value: the product, the PV01 and the quantity
+*/
+template<typename T>
+struct SerializerTraits<PV01<T>>
+{
+	static const bool Defined = true;
+	static size_t MaxSize(const PV01<T>& data)
+	{
+		return data.GetProduct().GetProductId().size() + FixedTextSize + LongTextSize + 3;
+	}
+	static size_t Write(const PV01<T>& data, char* buf)
+	{
+		char* p = buf + WriteText(buf, data.GetProduct().GetProductId());
+		*p++ = ',';
+		p += WriteFixed(p, data.GetPV01());
+		*p++ = ',';
+		p += WriteLong(p, data.GetQuantity());
+		*p++ = '\n';
+		return p - buf;
+	}
+};
+
+/*
+* Columns of a PV01 value
+*/
+template<typename T>
+struct ColumnarTraits<PV01<T>>
+{
+	static const int Columns = 4;
+	static const ColumnSpec* GetColumns()
+	{
+		static const ColumnSpec columns[] = { { "timestamp", COLUMN_INT64 }, { "product", COLUMN_STRING }, { "pv01", COLUMN_FLOAT64 }, { "quantity", COLUMN_INT64 } };
+		return columns;
+	}
+	template<typename W>
+	static void Write(W& writer, long long timestamp, const PV01<T>& data)
+	{
+		ColumnCell row[Columns];
+		row[0].i = timestamp;
+		row[1].i = writer.Code(data.GetProduct().GetProductId());
+		row[2].d = data.GetPV01();
+		row[3].i = data.GetQuantity();
+		writer.AppendRow(row);
+	}
+};
+
 /**
  * A bucket sector to bucket a group of securities.
  * We can then aggregate bucketed risk to this bucket.
@@ -83,6 +131,83 @@ private:
 };
 
 
+/**
+ * Tenor buckets to split risk along the curve (e.g. 2Y, 3Y, 5Y, ... 30Y).
+ * A tenor between two buckets is split onto them with linear weights.
+ */
+class TenorBuckets
+{
+
+public:
+
+  // ctor for the tenor buckets, default to the on-the-run tenors
+	TenorBuckets() : TenorBuckets(vector<double>{ 2, 3, 5, 7, 10, 20, 30 }) {}
+	TenorBuckets(const vector<double>& _tenors) : tenors(_tenors) {}
+
+  // Get the tenors of the buckets
+	const vector<double>& GetTenors() const
+	{
+		return tenors;
+	}
+
+  // Get the number of buckets
+	size_t GetSize() const
+	{
+		return tenors.size();
+	}
+
+  // Get the name of a bucket, e.g. 10Y
+	string GetName(size_t i) const
+	{
+		return to_string((int)tenors[i]) + "Y";
+	}
+
+  // Get the weights of a tenor on each of the buckets (summing to one)
+	vector<double> GetWeights(double tenor) const
+	{
+		vector<double> weights(tenors.size(), 0.0);
+		if (tenors.empty()) return weights;
+		if (tenor <= tenors.front())
+		{
+			weights.front() = 1.0;
+			return weights;
+		}
+		if (tenor >= tenors.back())
+		{
+			weights.back() = 1.0;
+			return weights;
+		}
+		for (size_t i = 0; i + 1 < tenors.size(); i++)
+		{
+			if (tenor >= tenors[i] && tenor < tenors[i + 1])
+			{
+				double w = (tenors[i + 1] - tenor) / (tenors[i + 1] - tenors[i]);
+				weights[i] = w;
+				weights[i + 1] = 1.0 - w;
+				break;
+			}
+		}
+		return weights;
+	}
+
+  // Get the buckets a tenor has weight on as a bitmask (bit i for bucket i)
+	unsigned long long GetMask(double tenor) const
+	{
+		vector<double> weights = GetWeights(tenor);
+		unsigned long long mask = 0;
+		for (size_t i = 0; i < weights.size() && i < 64; i++)
+		{
+			if (weights[i] != 0.0) mask |= (1ULL << i);
+		}
+		return mask;
+	}
+
+private:
+  vector<double> tenors;
+
+};
+
+
 /*
 * Pre definition of a listener to the position
 */
@@ -92,6 +217,9 @@ class RiskPositionListener;
 
 /**
  * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
+ * With snapshots enabled, the risk is snapshotted every interval positions. A position is risked
+ * per trade, so with the interval of the position snapshots both cover the same trades; a risk
+ * snapshot of other trades is not restored, the risk of the restored positions is computed instead.
  * Keyed on product identifier.
  * Type T is the product type.
  */
@@ -103,6 +231,12 @@ private:
 	vector<ServiceListener<PV01<T>>*> listeners;
 	RiskPositionListener<T>* position_listener;
 
+	//Snapshots: writer, buffer, interval and the number of positions risked
+	SnapshotWriter* snapshotwriter;
+	SnapshotBuffer snapshotbuffer;
+	unsigned long long snapshotinterval;
+	unsigned long long positioncount;
+
 public:
 	//Ctor and Dtor
 	RiskService()
@@ -110,9 +244,15 @@ public:
 		pv01map = map<string, PV01<T>>();
 		listeners = vector<ServiceListener<PV01<T>>*>();
 		position_listener = new RiskPositionListener<T>(this);
+		snapshotwriter = nullptr;
+		snapshotinterval = 0;
+		positioncount = 0;
 	}
 
-	~RiskService() = default;
+	~RiskService()
+	{
+		delete snapshotwriter;
+	}
 
 	// Get data on our service given a key
 	virtual PV01<T>& GetData(string key)
@@ -160,6 +300,78 @@ public:
 		long quantity = position.GetAggregatePosition();
 		PV01<T> pv01(product, pv01_value, quantity);
 		OnMessage(pv01);
+
+		positioncount++;
+		if (snapshotwriter != nullptr && positioncount % snapshotinterval == 0) TakeSnapshot();
+	}
+
+	// Snapshot the risk to base.0 / base.1 every interval positions
+	void EnableSnapshots(const string& base, unsigned long long interval)
+	{
+		delete snapshotwriter;
+		snapshotwriter = new SnapshotWriter(base);
+		snapshotinterval = interval > 0 ? interval : 1;
+	}
+
+	// Hand the risk to the snapshot writer, returns false if it is still writing the last one
+	bool TakeSnapshot()
+	{
+		if (snapshotwriter == nullptr || snapshotwriter->IsBusy()) return false;
+		snapshotbuffer.Put((unsigned int)pv01map.size());
+		for (auto p = pv01map.begin(); p != pv01map.end(); p++)
+		{
+			snapshotbuffer.PutString(p->first);
+			snapshotbuffer.Put(p->second.GetPV01());
+			snapshotbuffer.Put(p->second.GetQuantity());
+		}
+		return snapshotwriter->Submit(snapshotbuffer, positioncount);
+	}
+
+	// Snapshot the current state and wait until it is written
+	void FlushSnapshots()
+	{
+		if (snapshotwriter == nullptr) return;
+		snapshotwriter->Flush();
+		TakeSnapshot();
+		snapshotwriter->Flush();
+	}
+
+	// Load the risk of the latest snapshot, without notifying the listeners, if it covers the trades of
+	// the restored positions; otherwise (missing, invalid, older or newer) the risk of the restored
+	// positions is computed again. Returns the number of positions the risk covers
+	unsigned long long RestoreSnapshot(const string& base, const PositionService<T>& positionservice)
+	{
+		unsigned long long covered = positionservice.GetTradeCount();
+		vector<char> payload;
+		unsigned long long position = 0;
+		map<string, PV01<T>> restored;
+		bool loaded = SnapshotWriter::Load(base, payload, position) && position == covered;
+		if (loaded)
+		{
+			SnapshotReader reader(payload);
+			unsigned int count = reader.Get<unsigned int>();
+			for (unsigned int i = 0; i < count && reader.IsOk(); i++)
+			{
+				string id = reader.GetString();
+				double pv01 = reader.Get<double>();
+				long quantity = reader.Get<long>();
+				restored[id] = PV01<T>(FindProduct<T>(id), pv01, quantity);
+			}
+			loaded = reader.IsOk();
+		}
+		if (!loaded)
+		{
+			restored.clear();
+			const map<string, Position<T>>& positions = positionservice.GetAllPositions();
+			for (auto p = positions.begin(); p != positions.end(); p++)
+			{
+				Position<T> position = p->second;
+				restored[p->first] = PV01<T>(position.GetProduct(), CaluculatePV01(p->first), position.GetAggregatePosition());
+			}
+		}
+		pv01map.swap(restored);
+		positioncount = covered;
+		return covered;
 	}
 
 	// Get the bucketed risk for the bucket sector
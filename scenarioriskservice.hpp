@@ -0,0 +1,413 @@
+/**
+ * scenarioriskservice.hpp
+ * Defines the data types and Service for scenario (P&L ladder) risk.
+ *
+ * @author Tengxiao Fan
+ */
+#ifndef SCENARIO_RISK_SERVICE_HPP
+#define SCENARIO_RISK_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <sstream>
+#include "soa.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+/**
+ * A curve scenario: a shift in bp for each of the tenor buckets.
+ */
+class CurveScenario
+{
+
+public:
+
+  // ctor for a scenario
+	CurveScenario() {}
+	CurveScenario(string _name, const vector<double>& _shifts) : name(_name), shifts(_shifts) {}
+
+  // Get the name of the scenario
+	const string& GetName() const
+	{
+		return name;
+	}
+
+  // Get the shifts (in bp) of each tenor bucket
+	const vector<double>& GetShifts() const
+	{
+		return shifts;
+	}
+
+private:
+  string name;
+  vector<double> shifts;
+
+};
+
+/**
+ * P&L ladder of a book or a bucket sector across all the scenarios.
+ * A sector ladder is named by SectorPrefix and the sector name, apart from the books.
+ * Type T is the product type.
+ */
+template<typename T>
+class ScenarioLadder
+{
+
+public:
+
+  // ctor for a ladder
+	ScenarioLadder() {}
+	ScenarioLadder(string _name, const vector<double>& _pnl) : name(_name), pnl(_pnl) {}
+
+  // Get the name of the book or sector
+	const string& GetName() const
+	{
+		return name;
+	}
+
+  // Get the P&L of each scenario
+	const vector<double>& GetPnL() const
+	{
+		return pnl;
+	}
+
+	//Output function
+	ostream& Output(ostream& file)
+	{
+		file << GetName();
+		for (auto p = pnl.begin(); p != pnl.end(); p++)
+		{
+			file << "," << (*p);
+		}
+		file << endl;
+		return file;
+	}
+
+private:
+  string name;
+  vector<double> pnl;
+
+};
+
+/*
+* Pre definition of a listener to the position
+*/
+template <typename T>
+class ScenarioRiskPositionListener;
+
+//Prefix of the ladder names of the sectors, so that a sector and a book never share a key
+const string SectorPrefix = "SECTOR:";
+
+/**
+ * Scenario Risk Service revaluing the book under a grid of parallel and key-rate curve shifts.
+ * Keyed on book name, or on SectorPrefix and the bucket sector name.
+ * Type T is the product type.
+ */
+template<typename T>
+class ScenarioRiskService : public Service<string, ScenarioLadder<T> >
+{
+private:
+	map<string, ScenarioLadder<T>> laddermap;
+	vector<ServiceListener<ScenarioLadder<T>>*> listeners;
+	ScenarioRiskPositionListener<T>* position_listener;
+	map<string, Position<T>> positions;
+	vector<BucketedSector<T>> sectors;
+	vector<CurveScenario> scenarios;
+	TenorBuckets buckets;
+	//Shift sizes of the scenario grid, empty if the scenarios were set directly
+	vector<double> gridsizes;
+	int threads;
+
+public:
+	//Ctor and Dtor
+	ScenarioRiskService()
+	{
+		laddermap = map<string, ScenarioLadder<T>>();
+		listeners = vector<ServiceListener<ScenarioLadder<T>>*>();
+		position_listener = new ScenarioRiskPositionListener<T>(this);
+		threads = max(1, (int)thread::hardware_concurrency());
+
+		//Default sectors
+		sectors.push_back(BucketedSector<T>({ MakeBond("TMUBMUSD02Y"), MakeBond("TMUBMUSD03Y") }, "FrontEnd"));
+		sectors.push_back(BucketedSector<T>({ MakeBond("TMUBMUSD05Y"), MakeBond("TMUBMUSD07Y"), MakeBond("TMUBMUSD10Y") }, "Belly"));
+		sectors.push_back(BucketedSector<T>({ MakeBond("TMUBMUSD20Y"), MakeBond("TMUBMUSD30Y") }, "LongEnd"));
+
+		//Default grid: parallel and key-rate shifts of +-1..+-100bp
+		MakeScenarioGrid(vector<double>{ 1, 5, 10, 25, 50, 100 });
+	}
+	~ScenarioRiskService() = default;
+
+	// Get data on our service given a key
+	virtual ScenarioLadder<T>& GetData(string key)
+	{
+		return laddermap[key];
+	}
+
+	// The callback that a Connector should invoke for any new or updated data
+	virtual void OnMessage(ScenarioLadder<T>& data)
+	{
+		string key = data.GetName();
+		laddermap[key] = data;
+		//Call all the listeners
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(data);
+		}
+	}
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	virtual void AddListener(ServiceListener<ScenarioLadder<T>>* listener)
+	{
+		listeners.push_back(listener);
+	}
+
+	// Get all listeners on the Service
+	virtual const vector<ServiceListener<ScenarioLadder<T>>*>& GetListeners() const
+	{
+		return listeners;
+	}
+
+	// Get the listener to the position service
+	ScenarioRiskPositionListener<T>* GetPositionListener()
+	{
+		return position_listener;
+	}
+
+	// Add (or replace) the position of a product
+	void AddPosition(Position<T>& position)
+	{
+		positions[position.GetProduct().GetProductId()] = position;
+	}
+
+	// Set the tenor buckets that key-rate shifts apply to, rebuilding the scenario grid on them.
+	// Scenarios set directly have one shift per bucket, so set them after the buckets.
+	void SetTenorBuckets(const TenorBuckets& b)
+	{
+		buckets = b;
+		if (!gridsizes.empty()) MakeScenarioGrid(gridsizes);
+	}
+
+	// Set the scenarios, each with one shift per tenor bucket
+	void SetScenarios(const vector<CurveScenario>& s)
+	{
+		scenarios = s;
+		gridsizes.clear();
+	}
+
+	// Build a grid of +-size parallel shifts and +-size shifts on each key rate
+	void MakeScenarioGrid(const vector<double>& sizes)
+	{
+		scenarios = vector<CurveScenario>();
+		gridsizes = sizes;
+		size_t n = buckets.GetSize();
+		for (auto s = sizes.begin(); s != sizes.end(); s++)
+		{
+			for (int sign = -1; sign <= 1; sign += 2)
+			{
+				double shift = sign * (*s);
+				//Shortest text of the size, so that fractional sizes keep distinct names
+				ostringstream size;
+				size << *s;
+				string bp = (sign > 0 ? "+" : "-") + size.str() + "bp";
+				scenarios.push_back(CurveScenario("PARALLEL" + bp, vector<double>(n, shift)));
+				for (size_t b = 0; b < n; b++)
+				{
+					vector<double> shifts(n, 0.0);
+					shifts[b] = shift;
+					scenarios.push_back(CurveScenario(buckets.GetName(b) + bp, shifts));
+				}
+			}
+		}
+	}
+
+	// Get the scenarios
+	const vector<CurveScenario>& GetScenarios() const
+	{
+		return scenarios;
+	}
+
+	// Add a bucket sector to publish a ladder for
+	void AddSector(const BucketedSector<T>& sector)
+	{
+		sectors.push_back(sector);
+	}
+
+	// Set the number of worker threads
+	void SetThreads(int n)
+	{
+		threads = max(1, n);
+	}
+
+	// Revalue all positions under every scenario and publish a ladder per book and per sector
+	void RunScenarios()
+	{
+		size_t nb = buckets.GetSize();
+		size_t ns = scenarios.size();
+
+		//Shift matrix, bucket-major so that each row is contiguous across scenarios
+		vector<double> shiftmatrix(nb * ns);
+		for (size_t s = 0; s < ns; s++)
+		{
+			const vector<double>& shifts = scenarios[s].GetShifts();
+			for (size_t b = 0; b < nb && b < shifts.size(); b++)
+			{
+				shiftmatrix[b * ns + s] = shifts[b];
+			}
+		}
+
+		//Ladder groups: books first, then sectors
+		vector<string> groupnames;
+		map<string, int> bookgroups;
+		map<string, vector<int>> productsectors;
+		for (auto p = positions.begin(); p != positions.end(); p++)
+		{
+			const map<string, long>& books = p->second.GetPositions();
+			for (auto b = books.begin(); b != books.end(); b++)
+			{
+				if (bookgroups.find(b->first) == bookgroups.end())
+				{
+					bookgroups[b->first] = (int)groupnames.size();
+					groupnames.push_back(b->first);
+				}
+			}
+		}
+		for (auto s = sectors.begin(); s != sectors.end(); s++)
+		{
+			int group = (int)groupnames.size();
+			groupnames.push_back(SectorPrefix + s->GetName());
+			const vector<T>& products = s->GetProducts();
+			for (auto p = products.begin(); p != products.end(); p++)
+			{
+				productsectors[p->GetProductId()].push_back(group);
+			}
+		}
+
+		//Flatten the book into rows of (pv01 exposure, bucket weights, groups)
+		vector<double> exposures;
+		vector<double> weights;
+		vector<int> groupoffsets{ 0 };
+		vector<int> groups;
+		for (auto p = positions.begin(); p != positions.end(); p++)
+		{
+			string id = p->first;
+			double pv01 = CaluculatePV01(id);
+			vector<double> w = buckets.GetWeights(GetTenor(id));
+			const vector<int>& sectorgroups = productsectors[id];
+			const map<string, long>& books = p->second.GetPositions();
+			for (auto b = books.begin(); b != books.end(); b++)
+			{
+				if (b->second == 0) continue;
+				//P&L per bp is the negative of the PV01 exposure
+				exposures.push_back(-pv01 * b->second);
+				weights.insert(weights.end(), w.begin(), w.end());
+				groups.push_back(bookgroups[b->first]);
+				groups.insert(groups.end(), sectorgroups.begin(), sectorgroups.end());
+				groupoffsets.push_back((int)groups.size());
+			}
+		}
+
+		size_t ng = groupnames.size();
+		size_t nrows = exposures.size();
+		int nthreads = (int)min<size_t>(threads, max<size_t>(1, nrows / 256));
+		vector<vector<double>> partial(nthreads, vector<double>(ng * ns, 0.0));
+		atomic<size_t> next(0);
+		const size_t chunk = 256;
+
+		//Workers claim chunks of rows until the book is exhausted
+		auto worker = [&](int t)
+		{
+			double* acc = partial[t].data();
+			vector<double> rowpnl(ns);
+			while (true)
+			{
+				size_t begin = next.fetch_add(chunk);
+				if (begin >= nrows) break;
+				size_t end = min(begin + chunk, nrows);
+				for (size_t r = begin; r < end; r++)
+				{
+					fill(rowpnl.begin(), rowpnl.end(), 0.0);
+					for (size_t b = 0; b < nb; b++)
+					{
+						double a = exposures[r] * weights[r * nb + b];
+						if (a == 0.0) continue;
+						const double* shifts = &shiftmatrix[b * ns];
+						for (size_t s = 0; s < ns; s++)
+						{
+							rowpnl[s] += a * shifts[s];
+						}
+					}
+					for (int g = groupoffsets[r]; g < groupoffsets[r + 1]; g++)
+					{
+						double* out = acc + groups[g] * ns;
+						for (size_t s = 0; s < ns; s++)
+						{
+							out[s] += rowpnl[s];
+						}
+					}
+				}
+			}
+		};
+
+		vector<thread> pool;
+		for (int t = 1; t < nthreads; t++)
+		{
+			pool.push_back(thread(worker, t));
+		}
+		worker(0);
+		for (auto t = pool.begin(); t != pool.end(); t++)
+		{
+			t->join();
+		}
+
+		//Reduce and publish
+		for (size_t g = 0; g < ng; g++)
+		{
+			vector<double> pnl(ns, 0.0);
+			for (int t = 0; t < nthreads; t++)
+			{
+				const double* acc = &partial[t][g * ns];
+				for (size_t s = 0; s < ns; s++)
+				{
+					pnl[s] += acc[s];
+				}
+			}
+			ScenarioLadder<T> ladder(groupnames[g], pnl);
+			OnMessage(ladder);
+		}
+	}
+
+};
+
+/*
+* Scenario risk to position listener
+*/
+template<typename T>
+class ScenarioRiskPositionListener : public ServiceListener<Position<T>>
+{
+private:
+	ScenarioRiskService<T>* service;
+
+public:
+	//Ctor and Dtor
+	ScenarioRiskPositionListener(ScenarioRiskService<T>* s)
+	{
+		service = s;
+	}
+	~ScenarioRiskPositionListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Position<T>& data)
+	{
+		service->AddPosition(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Position<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Position<T>& data){}
+};
+
+#endif
@@ -0,0 +1,112 @@
+/*
+* serializer.hpp
+* Allocation-free text serializers writing records into char buffers
+* Author: Tengxiao Fan
+*/
+
+#ifndef SERIALIZER_HPP
+#define SERIALIZER_HPP
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include "functionalities.hpp"
+
+using namespace std;
+
+//Longest text of a long and of a double in fixed notation with 6 decimals
+const size_t LongTextSize = 20;
+const size_t FixedTextSize = 330;
+
+/*
+* Traits writing a record as its CSV line: MaxSize bounds the bytes of a record and Write formats
+* it into a buffer of at least that size, returning the bytes written. Doubles are written in
+* fixed notation with 6 decimals, the text a stream set to fixed and setprecision(6) gives.
+* Types without traits have no serializer.
+*/
+template<typename V>
+struct SerializerTraits
+{
+	static const bool Defined = false;
+	static size_t MaxSize(const V&)
+	{
+		return 0;
+	}
+	static size_t Write(const V&, char*)
+	{
+		return 0;
+	}
+};
+
+// Write a string, returns its size
+size_t WriteText(char* buf, const char* s, size_t size)
+{
+	memcpy(buf, s, size);
+	return size;
+}
+
+// Write a string
+size_t WriteText(char* buf, const string& s)
+{
+	return WriteText(buf, s.data(), s.size());
+}
+
+// Write an integer
+size_t WriteLong(char* buf, long long value)
+{
+	return to_chars(buf, buf + LongTextSize, value).ptr - buf;
+}
+
+// Write a double in fixed notation with 6 decimals, as printf("%.6f") does.
+// Prices on the 2^-20 tick grid (every 1/256 price) are written from their ticks: the 6 decimals of
+// a fraction f/2^20 are f*15625/2^14, rounded half to even, which is exact.
+size_t WriteFixed(char* buf, double value)
+{
+	long long ticks = fabs(value) < 1e12 ? PriceToTicks(value) : 0;
+	if (TicksToPrice(ticks) != value || signbit(value) != (ticks < 0))
+	{
+		return to_chars(buf, buf + FixedTextSize, value, chars_format::fixed, 6).ptr - buf;
+	}
+	char* p = buf;
+	if (ticks < 0) *p++ = '-';
+	unsigned long long magnitude = ticks < 0 ? 0ULL - (unsigned long long)ticks : (unsigned long long)ticks;
+	unsigned long long whole = magnitude >> 20;
+	unsigned long long scaled = (magnitude & 0xFFFFF) * 15625;
+	unsigned long long micros = scaled >> 14;
+	unsigned long long rest = scaled & 0x3FFF;
+	if (rest > 0x2000 || (rest == 0x2000 && (micros & 1))) micros++;
+	if (micros == 1000000)
+	{
+		whole++;
+		micros = 0;
+	}
+	p = to_chars(p, p + LongTextSize, whole).ptr;
+	*p++ = '.';
+	for (int i = 6; i >= 1; i--)
+	{
+		p[i - 1] = (char)('0' + micros % 10);
+		micros /= 10;
+	}
+	return p + 6 - buf;
+}
+
+// Write a record to a stream through its serializer
+template<typename V>
+ostream& Serialize(ostream& out, const V& data)
+{
+	char local[1024];
+	vector<char> large;
+	char* buf = local;
+	size_t size = SerializerTraits<V>::MaxSize(data);
+	if (size > sizeof(local))
+	{
+		large.resize(size);
+		buf = large.data();
+	}
+	return out.write(buf, SerializerTraits<V>::Write(data, buf));
+}
+
+#endif // !SERIALIZER_HPP
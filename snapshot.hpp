@@ -0,0 +1,297 @@
+/*
+* snapshot.hpp
+* Binary snapshots of service state, written on a background thread
+* Author: Tengxiao Fan
+*/
+
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include "journal.hpp"
+
+using namespace std;
+
+/*
+* Buffer a service serializes its state into
+*/
+class SnapshotBuffer
+{
+public:
+	vector<char> data;
+
+	// Append a trivially copyable value
+	template<typename V>
+	void Put(const V& value)
+	{
+		const char* p = (const char*)&value;
+		data.insert(data.end(), p, p + sizeof(V));
+	}
+
+	// Append a string with its length
+	void PutString(const string& s)
+	{
+		Put((unsigned int)s.size());
+		data.insert(data.end(), s.begin(), s.end());
+	}
+};
+
+/*
+* Reader over the payload of a snapshot, which fails (and stays failed) past its end
+*/
+class SnapshotReader
+{
+private:
+	const char* p;
+	const char* end;
+	bool ok;
+
+public:
+	//Ctor and Dtor
+	SnapshotReader(const vector<char>& data)
+	{
+		p = data.data();
+		end = p + data.size();
+		ok = true;
+	}
+	~SnapshotReader() = default;
+
+	// Has every read succeeded
+	bool IsOk() const
+	{
+		return ok;
+	}
+
+	// Read a trivially copyable value
+	template<typename V>
+	V Get()
+	{
+		V value = V();
+		if (!ok || end - p < (ptrdiff_t)sizeof(V))
+		{
+			ok = false;
+			return value;
+		}
+		memcpy(&value, p, sizeof(V));
+		p += sizeof(V);
+		return value;
+	}
+
+	// Read a string
+	string GetString()
+	{
+		unsigned int size = Get<unsigned int>();
+		if (!ok || end - p < (ptrdiff_t)size)
+		{
+			ok = false;
+			return string();
+		}
+		string s(p, size);
+		p += size;
+		return s;
+	}
+};
+
+/*
+* Double-buffered snapshot writer.
+* The pipeline serializes its state into a SnapshotBuffer and hands it over with Submit, which swaps
+* buffers and returns at once; a background thread writes and syncs the file. A snapshot submitted
+* while the previous one is still being written is skipped, so the pipeline never waits on the disk.
+* Snapshots alternate between base.0 and base.1, so a crash during a write keeps the previous one.
+* Each file is a header (sequence, position, size and CRC-32 of the payload) followed by the payload;
+* the position is the number of updates the state covers, where a journal replay resumes.
+* A snapshot that could not be written, synced or closed marks the writer failed until one succeeds.
+*/
+class SnapshotWriter
+{
+private:
+	struct Header
+	{
+		unsigned int magic;
+		unsigned int crc;
+		unsigned long long sequence;
+		unsigned long long position;
+		unsigned long long size;
+	};
+	static const unsigned int Magic = 0x504E5353;
+
+	string base;
+	vector<char> back;
+	unsigned long long backposition;
+	unsigned long long sequence;
+	bool busy;
+	bool stop;
+	bool failed;
+	mutex lock;
+	condition_variable signal;
+	thread writer;
+
+	static unsigned int Checksum(const Header& header, const vector<char>& payload)
+	{
+		unsigned int crc = Crc32(&header.sequence, sizeof(header.sequence) * 3);
+		return Crc32(payload.data(), payload.size(), crc);
+	}
+
+	// Read a snapshot file, returns false if it is missing or invalid
+	static bool Read(const string& filename, Header& header, vector<char>& payload)
+	{
+		int in = open(filename.c_str(), O_RDONLY);
+		if (in < 0) return false;
+		off_t filesize = lseek(in, 0, SEEK_END);
+		lseek(in, 0, SEEK_SET);
+		bool valid = read(in, &header, sizeof(Header)) == (ssize_t)sizeof(Header) && header.magic == Magic &&
+			header.size == (unsigned long long)(filesize - sizeof(Header));
+		if (valid)
+		{
+			payload.resize(header.size);
+			size_t done = 0;
+			while (done < payload.size())
+			{
+				ssize_t n = read(in, payload.data() + done, payload.size() - done);
+				if (n <= 0) break;
+				done += n;
+			}
+			valid = done == payload.size() && header.crc == Checksum(header, payload);
+		}
+		close(in);
+		return valid;
+	}
+
+	// Write the back buffer to the older of the two files, returns false if it is not durable
+	bool Write(unsigned long long s)
+	{
+		Header header;
+		header.magic = Magic;
+		header.sequence = s;
+		header.position = backposition;
+		header.size = back.size();
+		header.crc = Checksum(header, back);
+		string filename = base + (s % 2 == 0 ? ".0" : ".1");
+		int out = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (out < 0) return false;
+		vector<char> file((const char*)&header, (const char*)&header + sizeof(Header));
+		file.insert(file.end(), back.begin(), back.end());
+		size_t done = 0;
+		while (done < file.size())
+		{
+			ssize_t n = write(out, file.data() + done, file.size() - done);
+			if (n < 0 && errno == EINTR) continue;
+			if (n <= 0) break;
+			done += n;
+		}
+		int r;
+		while ((r = fdatasync(out)) != 0 && errno == EINTR) {}
+		bool synced = r == 0;
+		bool closed = close(out) == 0;
+		return done == file.size() && synced && closed;
+	}
+
+	// Background loop writing the submitted snapshots
+	void Run()
+	{
+		unique_lock<mutex> guard(lock);
+		while (true)
+		{
+			signal.wait(guard, [this] { return busy || stop; });
+			if (!busy) return;
+			unsigned long long s = ++sequence;
+			guard.unlock();
+			bool written = Write(s);
+			guard.lock();
+			failed = !written;
+			busy = false;
+			signal.notify_all();
+		}
+	}
+
+public:
+	//Ctor and Dtor
+	SnapshotWriter(const string& b)
+	{
+		base = b;
+		backposition = 0;
+		busy = false;
+		stop = false;
+		failed = false;
+		//Continue the sequence of the snapshots on disk
+		Header header;
+		vector<char> payload;
+		sequence = 0;
+		if (Read(base + ".0", header, payload)) sequence = max(sequence, header.sequence);
+		if (Read(base + ".1", header, payload)) sequence = max(sequence, header.sequence);
+		writer = thread(&SnapshotWriter::Run, this);
+	}
+	~SnapshotWriter()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			stop = true;
+		}
+		signal.notify_all();
+		writer.join();
+	}
+	SnapshotWriter(const SnapshotWriter&) = delete;
+	SnapshotWriter& operator=(const SnapshotWriter&) = delete;
+
+	// Is a snapshot being written
+	bool IsBusy()
+	{
+		lock_guard<mutex> guard(lock);
+		return busy;
+	}
+
+	// Did the last snapshot fail to be written
+	bool HasFailed()
+	{
+		lock_guard<mutex> guard(lock);
+		return failed;
+	}
+
+	// Hand a serialized state to the writer, swapping in its spare buffer (cleared)
+	// Returns false, leaving the buffer as it is, if the previous snapshot is still being written
+	bool Submit(SnapshotBuffer& buffer, unsigned long long position)
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			if (busy) return false;
+			back.swap(buffer.data);
+			backposition = position;
+			busy = true;
+		}
+		buffer.data.clear();
+		signal.notify_all();
+		return true;
+	}
+
+	// Wait until the last submitted snapshot is on disk
+	void Flush()
+	{
+		unique_lock<mutex> guard(lock);
+		signal.wait(guard, [this] { return !busy; });
+	}
+
+	// Load the latest valid snapshot of a base name, returns false if there is none
+	static bool Load(const string& base, vector<char>& payload, unsigned long long& position)
+	{
+		Header header0, header1;
+		vector<char> payload0, payload1;
+		bool valid0 = Read(base + ".0", header0, payload0);
+		bool valid1 = Read(base + ".1", header1, payload1);
+		if (!valid0 && !valid1) return false;
+		bool newer1 = valid1 && (!valid0 || header1.sequence > header0.sequence);
+		payload.swap(newer1 ? payload1 : payload0);
+		position = newer1 ? header1.position : header0.position;
+		return true;
+	}
+};
+
+#endif // !SNAPSHOT_HPP
@@ -82,6 +82,9 @@ public:
   //Subscribe data from the Connector
   virtual void Subscribe(ifstream &data) = 0;
 
+  // Connectors are deleted by the services owning them
+  virtual ~Connector() {}
+
 };
 
 #endif
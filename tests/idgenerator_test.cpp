@@ -0,0 +1,63 @@
+/*
+* idgenerator_test.cpp
+* Checks that IdGenerator hands out unique ids from 8 threads, and ids above a Reserve
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o idgenerator_test tests/idgenerator_test.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include "functionalities.hpp"
+
+int main()
+{
+	const int nthreads = 8;
+	const size_t perthread = 1000000;
+	int failures = 0;
+
+	//Ids drawn concurrently are all distinct
+	vector<vector<unsigned long long>> ids(nthreads);
+	vector<thread> pool;
+	for (int t = 0; t < nthreads; t++)
+	{
+		pool.push_back(thread([&ids, t, perthread]()
+		{
+			ids[t].reserve(perthread);
+			for (size_t i = 0; i < perthread; i++) ids[t].push_back(IdGenerator::NextId());
+		}));
+	}
+	for (auto t = pool.begin(); t != pool.end(); t++) t->join();
+	vector<unsigned long long> all;
+	for (auto v = ids.begin(); v != ids.end(); v++) all.insert(all.end(), v->begin(), v->end());
+	sort(all.begin(), all.end());
+	size_t repeated = all.size() - (unique(all.begin(), all.end()) - all.begin());
+	if (repeated != 0 || all.front() == 0)
+	{
+		cout << "FAIL: " << repeated << " repeated ids out of " << nthreads * perthread << endl;
+		failures++;
+	}
+
+	//After a Reserve, a thread holding a block moves past the reserved ids
+	IdGenerator::NextId();
+	unsigned long long reserved = all.back() + 100000;
+	IdGenerator::Reserve(reserved);
+	unsigned long long next = IdGenerator::NextId();
+	if (next <= reserved)
+	{
+		cout << "FAIL: id " << next << " after Reserve(" << reserved << ")" << endl;
+		failures++;
+	}
+
+	//A Reserve below the counter does not move it back
+	IdGenerator::Reserve(1);
+	unsigned long long later = IdGenerator::NextId();
+	if (later <= next)
+	{
+		cout << "FAIL: id " << later << " after " << next << endl;
+		failures++;
+	}
+
+	if (failures == 0) cout << "PASS: " << nthreads * perthread << " ids from " << nthreads << " threads are unique" << endl;
+	return failures == 0 ? 0 : 1;
+}
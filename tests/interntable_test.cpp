@@ -0,0 +1,49 @@
+/*
+* interntable_test.cpp
+* Checks that trades made on 8 threads intern their products and books consistently
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o interntable_test tests/interntable_test.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "functionalities.hpp"
+#include "tradebookingservice.hpp"
+
+int main()
+{
+	const int nthreads = 8;
+	const int perthread = 200000;
+	vector<string> cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+	vector<Bond> bonds;
+	for (auto c = cusips.begin(); c != cusips.end(); c++) bonds.push_back(MakeBond(*c));
+
+	//Every thread interns new books (spanning several blocks of the table) and shared products
+	vector<long> mismatches(nthreads, 0);
+	vector<thread> pool;
+	for (int t = 0; t < nthreads; t++)
+	{
+		pool.push_back(thread([&, t]()
+		{
+			for (int i = 0; i < perthread; i++)
+			{
+				string book = "B" + to_string(t) + "_" + to_string(i % 3000);
+				const Bond& bond = bonds[i % bonds.size()];
+				Trade<Bond> trade(bond, GenerateId(), 99.5, book, 1000000, BUY);
+				if (trade.GetBook() != book || trade.GetProduct().GetProductId() != bond.GetProductId()) mismatches[t]++;
+			}
+		}));
+	}
+	for (auto t = pool.begin(); t != pool.end(); t++) t->join();
+
+	long failures = 0;
+	for (int t = 0; t < nthreads; t++) failures += mismatches[t];
+	if (InternTable<string>::Find("B7_2999") < 0 || InternTable<Bond>::Find("TMUBMUSD30Y") < 0) failures++;
+	if (failures != 0)
+	{
+		cout << "FAIL: " << failures << " trades read back another product or book" << endl;
+		return 1;
+	}
+	cout << "PASS: " << nthreads * perthread << " trades from " << nthreads << " threads kept their product and book" << endl;
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+* recovery_test.cpp
+* Checks that new trades booked after a journal recovery get fresh ids, and that a journal
+* keeps the entries it failed to write, and that a journal file that cannot be opened is refused;
+* that restored risk matches the restored positions, and that a failed snapshot is reported
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o recovery_test tests/recovery_test.cpp
+* Run it from a scratch directory: it writes a journal there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <cstdio>
+#include "functionalities.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+// Book trades buying 1M each
+void BuyTrades(TradeBookingService<Bond>& service, const Bond& bond, int count)
+{
+	for (int i = 0; i < count; i++)
+	{
+		Trade<Bond> trade(bond, GenerateId(), 99.5, "TRSY1", 1000000, BUY);
+		service.OnMessage(trade);
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	Bond bond = MakeBond("TMUBMUSD02Y");
+	remove("recovery.journal");
+
+	//A previous process booked 5 trades with the first ids its generator handed out
+	{
+		TradeBookingService<Bond> tradebooking;
+		tradebooking.EnableJournal("recovery.journal", FSYNC_NEVER);
+		for (unsigned long long id = 1; id <= 5; id++)
+		{
+			Trade<Bond> trade(bond, IdToString(id), 99.5, "TRSY1", 1000000, BUY);
+			tradebooking.OnMessage(trade);
+		}
+		if (!tradebooking.CommitJournal())
+		{
+			cout << "FAIL: the journal could not be committed" << endl;
+			failures++;
+		}
+	}
+
+	//This process recovers them, its generator would hand out the same ids again
+	TradeBookingService<Bond> tradebooking;
+	PositionService<Bond> positions;
+	tradebooking.AddListener(positions.GetTradeBookingListener());
+	unsigned long long replayed = tradebooking.Recover("recovery.journal");
+	long recovered = positions.GetData("TMUBMUSD02Y").GetAggregatePosition();
+	if (replayed != 5 || recovered != 5000000)
+	{
+		cout << "FAIL: recovered " << replayed << " trades and a position of " << recovered << endl;
+		failures++;
+	}
+
+	//New bookings are not taken for replays of the recovered trades
+	for (int i = 0; i < 5; i++)
+	{
+		Trade<Bond> trade(bond, GenerateId(), 99.5, "TRSY1", 1000000, SELL);
+		tradebooking.OnMessage(trade);
+	}
+	long position = positions.GetData("TMUBMUSD02Y").GetAggregatePosition();
+	if (position != 0 || tradebooking.GetDuplicateCount() != 0)
+	{
+		cout << "FAIL: position " << position << " and " << tradebooking.GetDuplicateCount() << " duplicates after 5 new bookings" << endl;
+		failures++;
+	}
+
+	//A journal on a full device keeps its entries and reports the failure
+	{
+		Journal<TradeRecord> full("/dev/full", FSYNC_NEVER, 16);
+		if (full.IsOpen())
+		{
+			Trade<Bond> trade(bond, GenerateId(), 99.5, "TRSY1", 1000000, BUY);
+			full.Append(MakeTradeRecord(trade));
+			if (full.Commit() || !full.HasFailed() || full.Commit())
+			{
+				cout << "FAIL: a write to a full device was reported as committed" << endl;
+				failures++;
+			}
+		}
+	}
+
+	//A journal that cannot be opened buffers nothing and is not enabled
+	{
+		Journal<TradeRecord> missing("no-such-directory/trades.journal", FSYNC_NEVER, 16);
+		Trade<Bond> trade(bond, GenerateId(), 99.5, "TRSY1", 1000000, BUY);
+		missing.Append(MakeTradeRecord(trade));
+		if (missing.IsOpen() || !missing.HasFailed() || missing.Commit())
+		{
+			cout << "FAIL: appends to a journal that could not be opened were reported as committed" << endl;
+			failures++;
+		}
+		TradeBookingService<Bond> unjournaled;
+		if (unjournaled.EnableJournal("no-such-directory/trades.journal") || unjournaled.GetJournal() != nullptr)
+		{
+			cout << "FAIL: a journal that could not be opened was enabled" << endl;
+			failures++;
+		}
+	}
+
+	//Risk restored along positions: a risk snapshot of fewer trades than the positions is not used,
+	//one of the same trades is
+	for (int matching = 0; matching < 2; matching++)
+	{
+		const char* suffixes[] = { ".0", ".1" };
+		for (int s = 0; s < 2; s++)
+		{
+			remove((string("restore.positions") + suffixes[s]).c_str());
+			remove((string("restore.risk") + suffixes[s]).c_str());
+		}
+		{
+			TradeBookingService<Bond> booking;
+			PositionService<Bond> snapshotted;
+			RiskService<Bond> risk;
+			booking.AddListener(snapshotted.GetTradeBookingListener());
+			snapshotted.AddListener(risk.GetPositionListener());
+			snapshotted.EnableSnapshots("restore.positions", 1000000);
+			risk.EnableSnapshots("restore.risk", 1000000);
+			BuyTrades(booking, bond, 3);
+			if (!matching) risk.FlushSnapshots();
+			BuyTrades(booking, bond, 2);
+			snapshotted.FlushSnapshots();
+			if (matching) risk.FlushSnapshots();
+		}
+		PositionService<Bond> restoredpositions;
+		RiskService<Bond> restoredrisk;
+		unsigned long long from = restoredpositions.RestoreSnapshot("restore.positions");
+		unsigned long long covered = restoredrisk.RestoreSnapshot("restore.risk", restoredpositions);
+		long quantity = restoredrisk.GetData("TMUBMUSD02Y").GetQuantity();
+		if (from != 5 || covered != 5 || quantity != 5000000)
+		{
+			cout << "FAIL: positions of " << from << " trades restored with risk of " << covered << " positions and " << quantity << " risked" << endl;
+			failures++;
+		}
+	}
+
+	//A snapshot that cannot be written is reported
+	{
+		SnapshotWriter writer("no-such-directory/snapshot");
+		SnapshotBuffer buffer;
+		buffer.Put(1);
+		writer.Submit(buffer, 1);
+		writer.Flush();
+		if (!writer.HasFailed())
+		{
+			cout << "FAIL: a snapshot that could not be written was not reported" << endl;
+			failures++;
+		}
+	}
+
+	if (failures == 0) cout << "PASS: " << replayed << " recovered trades, new trades booked after them" << endl;
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/*
+* tradereplay_test.cpp
+* Checks that trades sent again are dropped: replaying trades.txt leaves the positions unchanged,
+* also after the positions were restored from a snapshot and the journal tail recovered
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o tradereplay_test tests/tradereplay_test.cpp
+* Run it from a scratch directory: it writes trades.txt, a journal and snapshots there
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include <cstdio>
+#include "functionalities.hpp"
+#include "positionservice.hpp"
+#include "DataGeneration.hpp"
+
+const vector<string> Cusips{ "TMUBMUSD02Y", "TMUBMUSD03Y", "TMUBMUSD05Y", "TMUBMUSD07Y", "TMUBMUSD10Y", "TMUBMUSD20Y", "TMUBMUSD30Y" };
+
+// Get the positions of each product by book
+map<string, map<string, long>> GetPositions(PositionService<Bond>& service)
+{
+	map<string, map<string, long>> positions;
+	for (auto c = Cusips.begin(); c != Cusips.end(); c++) positions[*c] = service.GetData(*c).GetPositions();
+	return positions;
+}
+
+// Book the trades of a file
+void BookFile(TradeBookingService<Bond>& service, const string& filename)
+{
+	ifstream data(filename);
+	service.GetConnector()->Subscribe(data);
+}
+
+// Copy lines [first, last) of a file
+void CopyLines(const string& from, const string& to, size_t first, size_t last)
+{
+	ifstream in(from);
+	ofstream out(to);
+	string line;
+	for (size_t i = 0; getline(in, line); i++)
+	{
+		if (i >= first && i < last) out << line << '\n';
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	GenerateTradeData();
+	size_t ntrades = 0;
+	{
+		ifstream in("trades.txt");
+		string line;
+		while (getline(in, line)) ntrades++;
+	}
+
+	//Replaying trades.txt in the same process
+	{
+		TradeBookingService<Bond> tradebooking;
+		PositionService<Bond> positions;
+		tradebooking.AddListener(positions.GetTradeBookingListener());
+		BookFile(tradebooking, "trades.txt");
+		map<string, map<string, long>> before = GetPositions(positions);
+		BookFile(tradebooking, "trades.txt");
+		if (GetPositions(positions) != before || tradebooking.GetDuplicateCount() != (long)ntrades)
+		{
+			cout << "FAIL: replaying trades.txt changed the positions (" << tradebooking.GetDuplicateCount() << " duplicates of " << ntrades << ")" << endl;
+			failures++;
+		}
+	}
+
+	//Replaying trades.txt after a snapshot restore and the recovery of the journal tail
+	remove("replay.journal");
+	remove("replay.snap.0");
+	remove("replay.snap.1");
+	CopyLines("trades.txt", "trades_head.txt", 0, ntrades / 2);
+	CopyLines("trades.txt", "trades_tail.txt", ntrades / 2, ntrades);
+	map<string, map<string, long>> booked;
+	{
+		TradeBookingService<Bond> tradebooking;
+		PositionService<Bond> positions;
+		tradebooking.AddListener(positions.GetTradeBookingListener());
+		tradebooking.EnableJournal("replay.journal", FSYNC_NEVER);
+		positions.EnableSnapshots("replay.snap", 1000000, tradebooking.GetJournal());
+		BookFile(tradebooking, "trades_head.txt");
+		positions.FlushSnapshots();
+		if (Journal<TradeRecord>::GetEntryCount("replay.journal") != ntrades / 2)
+		{
+			cout << "FAIL: the snapshot covers trades not written to the journal" << endl;
+			failures++;
+		}
+		BookFile(tradebooking, "trades_tail.txt");
+		tradebooking.CommitJournal();
+		booked = GetPositions(positions);
+	}
+	{
+		TradeBookingService<Bond> tradebooking;
+		PositionService<Bond> positions;
+		tradebooking.AddListener(positions.GetTradeBookingListener());
+		unsigned long long from = positions.RestoreSnapshot("replay.snap");
+		unsigned long long replayed = tradebooking.Recover("replay.journal", from);
+		if (from != ntrades / 2 || replayed != ntrades - ntrades / 2 || GetPositions(positions) != booked)
+		{
+			cout << "FAIL: recovery from the snapshot at " << from << " replayed " << replayed << " trades" << endl;
+			failures++;
+		}
+		BookFile(tradebooking, "trades.txt");
+		if (GetPositions(positions) != booked || tradebooking.GetDuplicateCount() != (long)ntrades)
+		{
+			cout << "FAIL: replaying trades.txt after recovery changed the positions (" << tradebooking.GetDuplicateCount() << " duplicates of " << ntrades << ")" << endl;
+			failures++;
+		}
+	}
+
+	if (failures == 0) cout << "PASS: " << ntrades << " replayed trades were all dropped" << endl;
+	return failures == 0 ? 0 : 1;
+}
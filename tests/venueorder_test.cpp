@@ -0,0 +1,100 @@
+/*
+* venueorder_test.cpp
+* Checks the orders resting at the simulated venue: an order amended down to its filled quantity
+* leaves the venue, and resting orders fill in price-time priority
+* Build from the repository root: g++ -std=c++17 -O2 -pthread -I. -o venueorder_test tests/venueorder_test.cpp
+* Author: Tengxiao Fan
+*/
+#include <iostream>
+#include "functionalities.hpp"
+#include "venueservice.hpp"
+
+// Counts the fills of the venue
+class FillCounter : public ServiceListener<Fill<Bond>>
+{
+public:
+	long filled = 0;
+	vector<unsigned long long> orders;
+
+	void ProcessAdd(Fill<Bond>& data)
+	{
+		filled += data.GetQuantity();
+		orders.push_back(data.GetOrderNumber());
+	}
+	void ProcessRemove(Fill<Bond>&) {}
+	void ProcessUpdate(Fill<Bond>&) {}
+};
+
+// A book of one level a side
+OrderBook<Bond> MakeBook(const Bond& bond, double bid, double offer, long quantity)
+{
+	return OrderBook<Bond>(bond, vector<Order>{ Order(bid, quantity, BID) }, vector<Order>{ Order(offer, quantity, OFFER) });
+}
+
+int main()
+{
+	int failures = 0;
+	Bond bond = MakeBond("TMUBMUSD02Y");
+	string cusip = bond.GetProductId();
+
+	//Amending an order down to its filled quantity cancels it at the venue
+	{
+		ExecutionService<Bond> execution;
+		VenueService<Bond> venue;
+		FillCounter counter;
+		execution.AddListener(venue.GetExecutionListener());
+		venue.AddListener(execution.GetVenueListener());
+		venue.AddListener(&counter);
+		venue.UpdateBook(MakeBook(bond, 99.0, 99.0 + 1 / 256.0, 1000000));
+
+		//A limit buy of 3M lifts the 1M offered and rests for 2M
+		ExecutionOrder<Bond> order(bond, OFFER, 101, LIMIT, 99.0 + 2 / 256.0, 3000000, 0, false);
+		execution.ExecuteOrder(order);
+		if (counter.filled != 1000000 || venue.GetRestingOrders(cusip).size() != 1)
+		{
+			cout << "FAIL: the order filled " << counter.filled << " and " << venue.GetRestingOrders(cusip).size() << " orders rest" << endl;
+			failures++;
+		}
+
+		//Amended to 0.5M, below the 1M filled: nothing is left open
+		if (!execution.AmendOrder(101, 99.0 + 2 / 256.0, 500000) || !venue.GetRestingOrders(cusip).empty() || execution.GetOrderStore().Find(101) != nullptr)
+		{
+			cout << "FAIL: the order amended below its filled quantity is still open" << endl;
+			failures++;
+		}
+
+		//New liquidity does not fill it any further
+		venue.UpdateBook(MakeBook(bond, 99.0, 99.0 + 1 / 256.0, 5000000));
+		if (counter.filled != 1000000)
+		{
+			cout << "FAIL: the cancelled order filled " << counter.filled << " in total" << endl;
+			failures++;
+		}
+	}
+
+	//A better limit resting later fills before a worse one resting earlier, equal limits by arrival
+	{
+		VenueService<Bond> venue;
+		FillCounter counter;
+		venue.AddListener(&counter);
+		venue.UpdateBook(MakeBook(bond, 99.0, 99.0 + 4 / 256.0, 1000000));
+		venue.SubmitOrder(ExecutionOrder<Bond>(bond, OFFER, 201, LIMIT, 99.0 + 1 / 256.0, 1000000, 0, false));
+		venue.SubmitOrder(ExecutionOrder<Bond>(bond, OFFER, 202, LIMIT, 99.0 + 3 / 256.0, 1000000, 0, false));
+		venue.SubmitOrder(ExecutionOrder<Bond>(bond, OFFER, 203, LIMIT, 99.0 + 3 / 256.0, 1000000, 0, false));
+		venue.SubmitOrder(ExecutionOrder<Bond>(bond, BID, 204, LIMIT, 99.0 + 8 / 256.0, 1000000, 0, false));
+		venue.SubmitOrder(ExecutionOrder<Bond>(bond, BID, 205, LIMIT, 99.0 + 6 / 256.0, 1000000, 0, false));
+		//1.5M a side, crossed by every resting order: it goes to the better buys and the better sell first
+		venue.UpdateBook(MakeBook(bond, 99.0 + 8 / 256.0, 99.0 + 1 / 256.0, 1500000));
+		vector<unsigned long long> expected{ 202, 203, 205, 204 };
+		if (counter.orders != expected || counter.filled != 3000000)
+		{
+			cout << "FAIL: resting orders filled out of price-time priority:";
+			for (auto o = counter.orders.begin(); o != counter.orders.end(); o++) cout << " " << *o;
+			cout << endl;
+			failures++;
+		}
+	}
+
+	if (failures == 0) cout << "PASS: the resting orders of the venue follow their amendments and price-time priority" << endl;
+	return failures == 0 ? 0 : 1;
+}
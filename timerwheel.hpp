@@ -0,0 +1,184 @@
+/*
+* timerwheel.hpp
+* Hierarchical timer wheel for scheduling a large number of timers
+* Author: Tengxiao Fan
+*/
+
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <vector>
+
+using namespace std;
+
+/*
+* Hierarchical timer wheel with four levels of 256 slots on a tick clock.
+* Timers live in a pooled node array linked into their slot, so scheduling
+* and cancelling are O(1). A timer carries a payload handed back when it fires.
+*/
+class TimerWheel
+{
+private:
+	static const int Levels = 4;
+	static const int Bits = 8;
+	static const int Slots = 1 << Bits;
+	static const unsigned long long Mask = Slots - 1;
+
+	struct Node
+	{
+		unsigned long long expiry;
+		unsigned long long payload;
+		int prev;
+		int next;
+		int level;
+		int slot;
+	};
+
+	vector<Node> nodes;
+	vector<int> freenodes;
+	int heads[Levels][Slots];
+	unsigned long long now;
+	long count;
+
+	// Link a node into the slot of its level
+	void Link(int n, int level, int slot)
+	{
+		Node& node = nodes[n];
+		node.level = level;
+		node.slot = slot;
+		node.prev = -1;
+		node.next = heads[level][slot];
+		if (node.next >= 0) nodes[node.next].prev = n;
+		heads[level][slot] = n;
+	}
+
+	// Unlink a node from its slot
+	void Unlink(int n)
+	{
+		Node& node = nodes[n];
+		if (node.prev >= 0) nodes[node.prev].next = node.next;
+		else heads[node.level][node.slot] = node.next;
+		if (node.next >= 0) nodes[node.next].prev = node.prev;
+	}
+
+	// Place a node on the level that covers its distance to now
+	void Place(int n)
+	{
+		unsigned long long expiry = nodes[n].expiry;
+		if (expiry < now) expiry = now;
+		unsigned long long delta = expiry - now;
+		int level = 0;
+		while (level < Levels - 1 && delta >= (1ULL << (Bits * (level + 1)))) level++;
+		Link(n, level, (int)((expiry >> (Bits * level)) & Mask));
+	}
+
+	// Move the timers of the current slot of a level down the wheel
+	void Cascade(int level)
+	{
+		int slot = (int)((now >> (Bits * level)) & Mask);
+		int n = heads[level][slot];
+		heads[level][slot] = -1;
+		while (n >= 0)
+		{
+			int next = nodes[n].next;
+			Place(n);
+			n = next;
+		}
+	}
+
+public:
+	//Ctor and Dtor
+	TimerWheel()
+	{
+		for (int l = 0; l < Levels; l++)
+		{
+			for (int s = 0; s < Slots; s++)
+			{
+				heads[l][s] = -1;
+			}
+		}
+		now = 0;
+		count = 0;
+	}
+	~TimerWheel() = default;
+
+	// Get the current tick (the next tick to be processed)
+	unsigned long long GetTime() const
+	{
+		return now;
+	}
+
+	// Get the number of live timers
+	long GetCount() const
+	{
+		return count;
+	}
+
+	// Schedule a timer at a tick, returns its handle
+	int Schedule(unsigned long long expiry, unsigned long long payload)
+	{
+		int n;
+		if (!freenodes.empty())
+		{
+			n = freenodes.back();
+			freenodes.pop_back();
+		}
+		else
+		{
+			n = (int)nodes.size();
+			nodes.push_back(Node());
+		}
+		nodes[n].expiry = expiry;
+		nodes[n].payload = payload;
+		Place(n);
+		count++;
+		return n;
+	}
+
+	// Cancel a live timer
+	void Cancel(int handle)
+	{
+		Unlink(handle);
+		freenodes.push_back(handle);
+		count--;
+	}
+
+	// Fire all timers expiring up to and including tick t, calling fire(payload) for each
+	template<typename F>
+	void Advance(unsigned long long t, F fire)
+	{
+		while (now <= t)
+		{
+			if (count == 0)
+			{
+				now = t + 1;
+				return;
+			}
+			if ((now & Mask) == 0)
+			{
+				//Cascade the higher levels whose index rolls over at this tick
+				for (int l = 1; l < Levels; l++)
+				{
+					Cascade(l);
+					if (((now >> (Bits * l)) & Mask) != 0) break;
+				}
+			}
+			int slot = (int)(now & Mask);
+			int n = heads[0][slot];
+			heads[0][slot] = -1;
+			now++;
+			//Timers scheduled while firing land on the next tick at the earliest
+			while (n >= 0)
+			{
+				int next = nodes[n].next;
+				unsigned long long payload = nodes[n].payload;
+				freenodes.push_back(n);
+				count--;
+				fire(payload);
+				n = next;
+			}
+		}
+	}
+};
+
+#endif // !TIMERWHEEL_HPP
@@ -9,14 +9,22 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include "soa.hpp"
 #include "executionservice.hpp"
+#include "venueservice.hpp"
+#include "archivesegment.hpp"
+#include "idfilter.hpp"
+#include "journal.hpp"
+#include "eventarena.hpp"
 
 // Trade sides
 enum Side { BUY, SELL };
 
 /**
  * Trade object with a price, side, and quantity on a particular book.
+ * The record is compact and fixed width: product and book are interned,
+ * the id is held in a fixed-width field (up to 15 chars) and the price in integer ticks.
  * Type T is the product type.
  */
 template<typename T>
@@ -26,14 +34,14 @@ class Trade
 public:
 
   // ctor for a trade
-	Trade() {}
+	Trade() : tradeId{}, price(0), quantity(0), side(BUY) {}
   Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side);
 
   // Get the product
   const T& GetProduct() const;
 
   // Get the trade ID
-  const string& GetTradeId() const;
+  string GetTradeId() const;
 
   // Get the mid price
   double GetPrice() const;
@@ -48,26 +56,72 @@ public:
   Side GetSide() const;
 
 private:
-  T product;
-  string tradeId;
-  double price;
-  string book;
+  char tradeId[16];
+  long long price;
   long quantity;
+  int product = -1;
+  int book = -1;
   Side side;
 
 };
 
+/**
+ * Compact fixed-width record of a trade for the archive.
+ */
+struct TradeRecord
+{
+	char tradeId[16];
+	char product[12];
+	char book[8];
+	double price;
+	long quantity;
+	Side side;
+};
+
+// Pack a trade into its archive record
+template<typename T>
+TradeRecord MakeTradeRecord(const Trade<T>& trade)
+{
+	TradeRecord record;
+	memset(&record, 0, sizeof(record));
+	PackString(record.tradeId, sizeof(record.tradeId), trade.GetTradeId());
+	PackString(record.product, sizeof(record.product), trade.GetProduct().GetProductId());
+	PackString(record.book, sizeof(record.book), trade.GetBook());
+	record.price = trade.GetPrice();
+	record.quantity = trade.GetQuantity();
+	record.side = trade.GetSide();
+	return record;
+}
+
+// Unpack a trade from its archive record
+template<typename T>
+Trade<T> MakeTrade(const TradeRecord& record)
+{
+	return Trade<T>(FindProduct<T>(UnpackString(record.product, sizeof(record.product))), UnpackString(record.tradeId, sizeof(record.tradeId)),
+		record.price, UnpackString(record.book, sizeof(record.book)), record.quantity, record.side);
+}
+
 /*
 * Pre declarations
 */
 template<typename T>
 class TradeBookingConnector;
 template<typename T>
-class TradeBookingExecutionListener;
+class TradeBookingFillListener;
 
 
 /**
  * Trade Booking Service to book trades to a particular book.
+ * With an archive enabled, booked trades (so reflected in the positions) are archived, and only
+ * the most recent ones are kept in the hot map; older ones are read back from the archive.
+ * Without one, every trade stays in the hot map.
+ * Trades are booked once per trade id: a resent or replayed trade is dropped. The ids of the
+ * hot trades are checked in a fingerprint set, archived ids in a bloom filter whose (rare) hits
+ * are confirmed in the archive segments whose own bloom filter also matches.
+ * With a journal enabled, each new trade is written ahead to it before the listeners see it,
+ * and Recover rebuilds the downstream state (positions, risk) by replaying a journal, or only its
+ * tail after the downstream services restored their snapshots, and moves the id generator past
+ * the replayed trade ids.
  * Keyed on trade id.
  * Type T is the product type.
  */
@@ -78,37 +132,241 @@ private:
 	map<string, Trade<T>> trades;
 	vector<ServiceListener<Trade<T>>*> listeners;
 	TradeBookingConnector<T>* connector;
-	TradeBookingExecutionListener<T>* execution_listener;
+	TradeBookingFillListener<T>* fill_listener;
+
+	//Archive of booked trades (nullptr if not enabled), and the hot trades in booking order
+	ArchiveSegment<TradeRecord>* archive;
+	deque<string> hotorder;
+	size_t hotcapacity;
+	Trade<T> archived;
+
+	//Duplicate detection on trade ids
+	FingerprintSet hotids;
+	BloomFilter archivedids;
+	vector<BloomFilter> segmentids;
+	size_t archivedcount;
+	size_t bloomcapacity;
+	bool archivecheck;
+	long duplicates;
+
+	//Write-ahead journal, and whether a journal is being replayed
+	Journal<TradeRecord>* journal;
+	bool recovering;
 
 public:
 	//Ctor and Dtors
 	TradeBookingService()
 	{
+		archive = nullptr;
+		hotcapacity = 10000;
+		archivedcount = 0;
+		bloomcapacity = 1 << 20;
+		archivedids = BloomFilter(bloomcapacity);
+		archivecheck = true;
+		duplicates = 0;
+		journal = nullptr;
+		recovering = false;
 		trades = map<string, Trade<T>>();
 		listeners = vector<ServiceListener<Trade<T>>*>();
 		connector = new TradeBookingConnector<T>(this);
-		execution_listener = new TradeBookingExecutionListener<T>(this);
+		fill_listener = new TradeBookingFillListener<T>(this);
+	}
+	~TradeBookingService()
+	{
+		delete archive;
+		delete journal;
 	}
-	~TradeBookingService() = default;
+	TradeBookingService(const TradeBookingService&) = delete;
+	TradeBookingService& operator=(const TradeBookingService&) = delete;
 
 	// Get data on our service given a key
 	virtual Trade<T>& GetData(string key)
 	{
-		return trades[key];
+		auto it = trades.find(key);
+		if (it != trades.end()) return it->second;
+		TradeRecord record;
+		if (archive != nullptr && archive->Find([&key](const TradeRecord& r) { return UnpackString(r.tradeId, sizeof(r.tradeId)) == key; }, record))
+		{
+			archived = MakeTrade<T>(record);
+		}
+		else
+		{
+			archived = Trade<T>();
+		}
+		return archived;
 	}
 
 	// The callback that a Connector should invoke for any new or updated data
 	virtual void OnMessage(Trade<T>& data)
+	{
+		Book(data, true);
+	}
+
+	// Book a trade once per id: journal it, notify the listeners and archive it.
+	// A trade already in the restored downstream state is only remembered (notify false).
+	void Book(Trade<T>& data, bool notify)
 	{
 		//Update the trade data
 		string key = data.GetTradeId();
+		unsigned long long fingerprint = Fingerprint(key);
+		//A journal holds each trade once, no need to check it while replaying
+		if (!recovering && IsDuplicate(key, fingerprint))
+		{
+			duplicates++;
+			return;
+		}
+		TradeRecord record = MakeTradeRecord(data);
+		if (journal != nullptr && !recovering) journal->Append(record);
 		trades[key] = data;
+		hotids.Insert(fingerprint);
 
 		//Notify all the listeners
-		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		for (auto i = listeners.begin(); notify && i != listeners.end(); i++)
 		{
 			(*i)->ProcessAdd(data);
 		}
+
+		//The trade is in the positions now, archive it and keep the hot map bounded
+		if (archive == nullptr) return;
+		//Queued first, so that a write failure of the archive leaves the record queued for eviction
+		hotorder.push_back(key);
+		archive->Append(record);
+		while (hotorder.size() > hotcapacity)
+		{
+			unsigned long long evicted = Fingerprint(hotorder.front());
+			hotids.Erase(evicted);
+			archivedids.Insert(evicted);
+			//Trades are archived in booking order, so the evicted one is record archivedcount
+			size_t s = archivedcount / archive->GetSegmentSize();
+			if (s == segmentids.size()) segmentids.push_back(BloomFilter(archive->GetSegmentSize()));
+			segmentids[s].Insert(evicted);
+			trades.erase(hotorder.front());
+			hotorder.pop_front();
+			if (++archivedcount > bloomcapacity) GrowBloomFilter(bloomcapacity * 2);
+		}
+	}
+
+	// Has a trade id been booked already
+	bool IsDuplicate(const string& key, unsigned long long fingerprint)
+	{
+		if (hotids.Contains(fingerprint) && trades.count(key)) return true;
+		if (archive == nullptr || !archivecheck || !archivedids.MayContain(fingerprint)) return false;
+		//Rare path: confirm in the candidate segments of the archive
+		char id[sizeof(TradeRecord::tradeId)];
+		PackString(id, sizeof(id), key);
+		bool found = false;
+		for (size_t s = segmentids.size(); s > 0 && !found; s--)
+		{
+			if (!segmentids[s - 1].MayContain(fingerprint)) continue;
+			archive->ForEachInSegment(s - 1, [&](const TradeRecord& r) { found = found || memcmp(r.tradeId, id, sizeof(id)) == 0; });
+		}
+		return found;
+	}
+
+	// Resize the bloom filter and refill it from the archive, keeping its false positive rate
+	void GrowBloomFilter(size_t capacity)
+	{
+		bloomcapacity = capacity;
+		archivedids = BloomFilter(bloomcapacity);
+		if (archive == nullptr) return;
+		archive->ForEach([this](const TradeRecord& r)
+		{
+			archivedids.Insert(Fingerprint(UnpackString(r.tradeId, sizeof(r.tradeId))));
+			return true;
+		});
+	}
+
+	// Check archived trade ids for duplicates too (on by default)
+	void SetArchiveCheck(bool check)
+	{
+		archivecheck = check;
+	}
+
+	// Get the number of duplicate trades dropped
+	long GetDuplicateCount() const
+	{
+		return duplicates;
+	}
+
+	// Journal every new trade to a file (continuing it if it exists), returns false (and journals
+	// nothing) if the file cannot be opened
+	bool EnableJournal(const string& filename, FsyncPolicy policy = FSYNC_GROUP, size_t group = 256)
+	{
+		delete journal;
+		journal = new Journal<TradeRecord>(filename, policy, group);
+		if (!journal->IsOpen())
+		{
+			delete journal;
+			journal = nullptr;
+			return false;
+		}
+		return true;
+	}
+
+	// Write and sync the trades not yet committed to the journal, returns false if they are not
+	// all durable (they are kept for the next commit)
+	bool CommitJournal()
+	{
+		return journal == nullptr || journal->Commit();
+	}
+
+	// Get the journal (nullptr if not enabled)
+	Journal<TradeRecord>* GetJournal()
+	{
+		return journal;
+	}
+
+	// Replay the trades of a journal through the listeners from an entry number (the position of a
+	// snapshot of the downstream state), returns the number of entries replayed. The trades before it
+	// are only remembered, so that they are still dropped as duplicates when they are sent again.
+	// New ids are then generated past the highest replayed one.
+	unsigned long long Recover(const string& filename, unsigned long long from = 0)
+	{
+		//Size the bloom filter for the whole journal up front
+		unsigned long long entries = Journal<TradeRecord>::GetEntryCount(filename);
+		size_t expected = archivedcount + (size_t)entries;
+		if (expected > bloomcapacity) GrowBloomFilter(expected);
+		recovering = true;
+		unsigned long long index = 0;
+		unsigned long long maxid = 0;
+		unsigned long long count = Journal<TradeRecord>::Replay(filename, [this, &index, &maxid, from](const TradeRecord& r)
+		{
+			Trade<T> trade = MakeTrade<T>(r);
+			Book(trade, index++ >= from);
+			unsigned long long id;
+			if (StringToId(UnpackString(r.tradeId, sizeof(r.tradeId)), id) && id > maxid) maxid = id;
+		});
+		recovering = false;
+		if (maxid > 0) IdGenerator::Reserve(maxid);
+		return count > from ? count - from : 0;
+	}
+
+	// Archive booked trades to a file (truncated, as the archive lives as long as the service) and
+	// keep only the most recent ones in the hot map; enable it before booking trades
+	// (throws runtime_error if the file cannot be opened, or later written)
+	void EnableArchive(const string& filename, size_t segmentsize = 4096)
+	{
+		ArchiveSegment<TradeRecord>* opened = new ArchiveSegment<TradeRecord>(filename, segmentsize);
+		delete archive;
+		archive = opened;
+	}
+
+	// Set the number of trades kept in the hot map when archiving
+	void SetHotCapacity(size_t n)
+	{
+		hotcapacity = n;
+	}
+
+	// Get the number of trades in the hot map
+	size_t GetHotCount() const
+	{
+		return trades.size();
+	}
+
+	// Get the archive of booked trades, nullptr if not enabled
+	ArchiveSegment<TradeRecord>* GetArchive()
+	{
+		return archive;
 	}
 
 	// Add a listener to the Service for callbacks on add, remove, and update events
@@ -130,10 +388,16 @@ public:
 		return connector;
 	}
 
-	//Get the listener to the execution
-	TradeBookingExecutionListener<T>* GetExecutionListener()
+	// Allocate the transient objects of the events read by the connector in an arena, nullptr for the global heap
+	void SetArena(EventArena* arena)
 	{
-		return execution_listener;
+		connector->SetArena(arena);
+	}
+
+	//Get the listener to the venue fills
+	TradeBookingFillListener<T>* GetFillListener()
+	{
+		return fill_listener;
 	}
 
 	// Book the trade
@@ -150,12 +414,14 @@ public:
 };
 
 template<typename T>
-Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
-  product(_product)
+Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book, long _quantity, Side _side)
 {
-  tradeId = _tradeId;
-  price = _price;
-  book = _book;
+  static_assert(sizeof(tradeId) > IdWidth, "the trade id field must hold a generated id");
+  product = InternTable<T>::Intern(_product.GetProductId(), _product);
+  PackString(tradeId, sizeof(tradeId) - 1, _tradeId);
+  tradeId[sizeof(tradeId) - 1] = 0;
+  price = PriceToTicks(_price);
+  book = InternTable<string>::Intern(_book, _book);
   quantity = _quantity;
   side = _side;
 }
@@ -163,25 +429,25 @@ Trade<T>::Trade(const T &_product, string _tradeId, double _price, string _book,
 template<typename T>
 const T& Trade<T>::GetProduct() const
 {
-  return product;
+  return InternTable<T>::Get(product);
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const
+string Trade<T>::GetTradeId() const
 {
-  return tradeId;
+  return string(tradeId);
 }
 
 template<typename T>
 double Trade<T>::GetPrice() const
 {
-  return price;
+  return TicksToPrice(price);
 }
 
 template<typename T>
 const string& Trade<T>::GetBook() const
 {
-  return book;
+  return InternTable<string>::Get(book);
 }
 
 template<typename T>
@@ -205,14 +471,23 @@ class TradeBookingConnector : public Connector<Trade<T>>
 {
 private:
 	TradeBookingService<T>* service;
+	//Arena of the transient objects of a line, nullptr for the global heap
+	EventArena* arena;
 public:
 	//Ctor and Dtor
 	TradeBookingConnector(TradeBookingService<T>* s)
 	{
 		service = s;
+		arena = nullptr;
 	}
 	~TradeBookingConnector() = default;
 
+	// Allocate the transient objects of the events read in an arena, nullptr for the global heap
+	void SetArena(EventArena* a)
+	{
+		arena = a;
+	}
+
 	//Publish Data
 	void Publish(Trade<T>& data) {}
 
@@ -224,8 +499,10 @@ public:
 		while (getline(data, line))
 		{
 			//cout << line << endl;
-			string ele = "";
-			vector<string> elements;
+			EventScope scope(arena);
+			pmr::memory_resource* resource = ArenaResource(arena);
+			pmr::string ele(resource);
+			pmr::vector<pmr::string> elements(resource);
 			for (int i = 0; i < line.size(); i++)
 			{
 				if (line[i] == ',')
@@ -239,11 +516,11 @@ public:
 				}
 			}
 			elements.push_back(ele);
-			string cusip = elements[0];
-			string tradeid = elements[1];
+			string cusip(elements[0]);
+			string tradeid(elements[1]);
 			double price = FractionaltoPrice(elements[2]);
-			string book = elements[3];
-			long quantity = stol(elements[4]);
+			string book(elements[3]);
+			long quantity = strtol(elements[4].c_str(), nullptr, 10);
 			Side side=BUY;
 			if (elements[5] == "SELL") side = SELL;
 			//std::cout << "end" << std::endl;
@@ -260,49 +537,41 @@ public:
 };
 
 /*
-* Listener to execution class
+* Listener to venue fills, each fill is booked as a trade
 */
 template<typename T>
-class TradeBookingExecutionListener : public ServiceListener<ExecutionOrder<T>>
+class TradeBookingFillListener : public ServiceListener<Fill<T>>
 {
 private:
 	TradeBookingService<T>* service;
 	long tradecount;
 public:
 	//Ctor and Dtor
-	TradeBookingExecutionListener(TradeBookingService<T>* s)
+	TradeBookingFillListener(TradeBookingService<T>* s)
 	{
 		service = s;
+		tradecount = 0;
 	}
-	~TradeBookingExecutionListener(){}
+	~TradeBookingFillListener() {}
 
 	// Listener callback to process an add event to the Service
-	void ProcessAdd(ExecutionOrder<T>& data)
+	void ProcessAdd(Fill<T>& data)
 	{
-		//std::cout << "Start" << endl;
 		tradecount++;
-		T product = data.GetProduct();
-		PricingSide pside = data.GetPricingSide();
-		string orderId = data.GetOrderId();
-		double price = data.GetPrice();
-		long quantity = data.GetQuantity();
-		Side side;
-		if (pside == BID) side = SELL;
-		else if (pside == OFFER) side = BUY;
+		Side side = data.GetPricingSide() == BID ? SELL : BUY;
 		string book;
 		if (tradecount % 3 == 1) book = "TRSY1";
-		else if(tradecount % 3 == 2) book = "TRSY2";
+		else if (tradecount % 3 == 2) book = "TRSY2";
 		else book = "TRSY3";
-		Trade<T> trade(product, orderId, price, book, quantity, side);
+		Trade<T> trade(data.GetProduct(), data.GetFillId(), data.GetPrice(), book, data.GetQuantity(), side);
 		service->OnMessage(trade);
-		//std::cout << orderId << "," << product.GetProductId() << "," << price << "," << book << "," << quantity << "," << side<<endl;
 	}
 
 	// Listener callback to process a remove event to the Service
-	void ProcessRemove(ExecutionOrder<T>& data) {}
+	void ProcessRemove(Fill<T>& data) {}
 
 	// Listener callback to process an update event to the Service
-	void ProcessUpdate(ExecutionOrder<T>& data) {}
+	void ProcessUpdate(Fill<T>& data) {}
 };
 
 
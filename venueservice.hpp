@@ -0,0 +1,397 @@
+/**
+ * venueservice.hpp
+ * Defines the data types and Service for a simulated execution venue.
+ *
+ * @author Tengxiao Fan
+ */
+#ifndef VENUE_SERVICE_HPP
+#define VENUE_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "soa.hpp"
+#include "marketdataservice.hpp"
+#include "executionservice.hpp"
+#include "timerwheel.hpp"
+
+/*
+* Pre declarations of the listeners
+*/
+template<typename T>
+class VenueMarketDataListener;
+template<typename T>
+class VenueExecutionListener;
+
+/**
+ * Simulated venue matching execution orders against the current market data book
+ * with price-time priority, and publishing fills after a configurable latency.
+ * Market and IOC orders cancel their remainder, FOK orders fill fully or not at all,
+ * limit orders rest and are matched again on later book updates, in price-time priority:
+ * the best limit first, and orders at the same limit in arrival order.
+ * Fills are published with ProcessAdd, and cancelled remainders with ProcessRemove
+ * (a Fill with zero quantity whose leaves quantity is the quantity cancelled).
+ * Each book update is one tick of the venue clock.
+ * Keyed on product identifier.
+ * Type T is the product type.
+ */
+template<typename T>
+class VenueService : public Service<string, Fill<T> >
+{
+private:
+	//A level of the venue book
+	struct Level
+	{
+		double price;
+		long quantity;
+	};
+
+	//Book of a product, levels sorted best first and then by arrival
+	struct Book
+	{
+		vector<Level> bids;
+		vector<Level> offers;
+		size_t bidhead = 0;
+		size_t offerhead = 0;
+		//Resting orders of both sides, each side in price-time priority
+		vector<ExecutionOrder<T>> resting;
+	};
+
+	map<string, Fill<T>> fillmap;
+	vector<ServiceListener<Fill<T>>*> listeners;
+	VenueMarketDataListener<T>* marketdata_listener;
+	VenueExecutionListener<T>* execution_listener;
+	unordered_map<string, Book> books;
+
+	//Fills and cancels waiting out the latency, pooled by slot, the slot is the payload of their timer
+	vector<pair<Fill<T>, bool>> pendingfills;
+	vector<int> freefills;
+	TimerWheel timers;
+	long latency;
+
+public:
+	//Ctor and Dtor
+	VenueService()
+	{
+		fillmap = map<string, Fill<T>>();
+		listeners = vector<ServiceListener<Fill<T>>*>();
+		marketdata_listener = new VenueMarketDataListener<T>(this);
+		execution_listener = new VenueExecutionListener<T>(this);
+		latency = 0;
+	}
+	~VenueService() = default;
+
+	// Get data on our service given a key
+	Fill<T>& GetData(string key)
+	{
+		return fillmap[key];
+	}
+
+	// The callback that a Connector should invoke for any new or updated data
+	void OnMessage(Fill<T>& data)
+	{
+		string key = data.GetProduct().GetProductId();
+		fillmap[key] = data;
+		//Call all the listeners
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(data);
+		}
+	}
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	void AddListener(ServiceListener<Fill<T>>* listener)
+	{
+		listeners.push_back(listener);
+	}
+
+	// Get all listeners on the Service
+	const vector<ServiceListener<Fill<T>>*>& GetListeners() const
+	{
+		return listeners;
+	}
+
+	// Get the listener to the market data service
+	VenueMarketDataListener<T>* GetMarketDataListener()
+	{
+		return marketdata_listener;
+	}
+
+	// Get the listener to the execution service
+	VenueExecutionListener<T>* GetExecutionListener()
+	{
+		return execution_listener;
+	}
+
+	// Set the latency of fills in ticks (book updates)
+	void SetLatency(long ticks)
+	{
+		latency = max(0L, ticks);
+	}
+
+	// Replace the book of a product with new market data and match resting orders against it
+	void UpdateBook(const OrderBook<T>& odb)
+	{
+		timers.Advance(timers.GetTime(), [this](unsigned long long slot) { ReleaseFill((int)slot); });
+
+		Book& book = books[odb.GetProduct().GetProductId()];
+		LoadLevels(odb.GetBidStack(), book.bids);
+		LoadLevels(odb.GetOfferStack(), book.offers);
+		//Bids best (highest) first, offers best (lowest) first, ties stay in arrival order
+		StableSortSmall(book.bids.begin(), book.bids.end(), [](const Level& a, const Level& b) { return a.price > b.price; });
+		StableSortSmall(book.offers.begin(), book.offers.end(), [](const Level& a, const Level& b) { return a.price < b.price; });
+		book.bidhead = 0;
+		book.offerhead = 0;
+
+		//Resting orders are matched in priority order, and keep it
+		size_t kept = 0;
+		for (size_t i = 0; i < book.resting.size(); i++)
+		{
+			ExecutionOrder<T> order = book.resting[i];
+			long remaining = Match(book, order, order.GetQuantity());
+			if (remaining > 0)
+			{
+				book.resting[kept++] = Resize(order, remaining);
+			}
+		}
+		book.resting.resize(kept);
+	}
+
+	// Submit an order to the venue
+	void SubmitOrder(const ExecutionOrder<T>& order)
+	{
+		Book& book = books[order.GetProduct().GetProductId()];
+		if (order.GetOrderType() == FOK && Available(book, order) < order.GetQuantity())
+		{
+			SendFill(Fill<T>(order.GetProduct(), order.GetPricingSide(), 0, order.GetOrderNumber(), order.GetPrice(), 0, order.GetQuantity()), true);
+			return;
+		}
+		long remaining = Match(book, order, order.GetQuantity());
+		if (remaining > 0 && order.GetOrderType() == LIMIT)
+		{
+			Rest(book, Resize(order, remaining));
+		}
+		else if (remaining > 0)
+		{
+			SendFill(Fill<T>(order.GetProduct(), order.GetPricingSide(), 0, order.GetOrderNumber(), order.GetPrice(), 0, remaining), true);
+		}
+	}
+
+	// Remove a resting order, returns false if it is not resting
+	bool CancelOrder(const ExecutionOrder<T>& order)
+	{
+		Book& book = books[order.GetProduct().GetProductId()];
+		for (auto o = book.resting.begin(); o != book.resting.end(); o++)
+		{
+			if (o->GetOrderNumber() == order.GetOrderNumber())
+			{
+				book.resting.erase(o);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Replace a resting order by its amended version, which loses its time priority
+	void ReplaceOrder(const ExecutionOrder<T>& order)
+	{
+		CancelOrder(order);
+		SubmitOrder(order);
+	}
+
+	// Get the resting orders of a product, in priority order on each side
+	vector<ExecutionOrder<T>> GetRestingOrders(const string& productId) const
+	{
+		auto it = books.find(productId);
+		return it == books.end() ? vector<ExecutionOrder<T>>() : it->second.resting;
+	}
+
+	// Get the number of fills waiting out the latency
+	long GetPendingFills() const
+	{
+		return timers.GetCount();
+	}
+
+private:
+	// Copy the orders of a stack into venue levels
+	void LoadLevels(const vector<Order>& stack, vector<Level>& levels)
+	{
+		levels.resize(stack.size());
+		for (size_t i = 0; i < stack.size(); i++)
+		{
+			levels[i].price = stack[i].GetPrice();
+			levels[i].quantity = stack[i].GetQuantity();
+		}
+	}
+
+	// Does a level cross the limit price of an order
+	bool Crosses(const ExecutionOrder<T>& order, double price) const
+	{
+		if (order.GetOrderType() == MARKET) return true;
+		return order.GetPricingSide() == BID ? price >= order.GetPrice() : price <= order.GetPrice();
+	}
+
+	// Quantity an order could fill right now
+	long Available(const Book& book, const ExecutionOrder<T>& order) const
+	{
+		const vector<Level>& levels = order.GetPricingSide() == BID ? book.bids : book.offers;
+		size_t head = order.GetPricingSide() == BID ? book.bidhead : book.offerhead;
+		long available = 0;
+		for (size_t i = head; i < levels.size() && Crosses(order, levels[i].price); i++)
+		{
+			available += levels[i].quantity;
+		}
+		return available;
+	}
+
+	// Match an order against the side it aggresses, returns the quantity left
+	long Match(Book& book, const ExecutionOrder<T>& order, long quantity)
+	{
+		//A BID order hits the bids, an OFFER order lifts the offers
+		vector<Level>& levels = order.GetPricingSide() == BID ? book.bids : book.offers;
+		size_t& head = order.GetPricingSide() == BID ? book.bidhead : book.offerhead;
+		while (quantity > 0 && head < levels.size() && Crosses(order, levels[head].price))
+		{
+			Level& level = levels[head];
+			long q = min(quantity, level.quantity);
+			level.quantity -= q;
+			quantity -= q;
+			if (level.quantity == 0) head++;
+			if (q > 0) SendFill(Fill<T>(order.GetProduct(), order.GetPricingSide(), IdGenerator::NextId(), order.GetOrderNumber(), level.price, q, quantity), false);
+		}
+		return quantity;
+	}
+
+	// Queue a limit order behind the resting orders of its side with the same or a better limit
+	void Rest(Book& book, const ExecutionOrder<T>& order)
+	{
+		//A BID order sells into the bids, the lowest limit is the best; an OFFER order buys
+		PricingSide side = order.GetPricingSide();
+		auto worse = [&order, side](const ExecutionOrder<T>& o)
+		{
+			return o.GetPricingSide() == side && (side == BID ? o.GetPrice() > order.GetPrice() : o.GetPrice() < order.GetPrice());
+		};
+		book.resting.insert(find_if(book.resting.begin(), book.resting.end(), worse), order);
+	}
+
+	// Copy of an order with a new quantity
+	ExecutionOrder<T> Resize(const ExecutionOrder<T>& order, long quantity) const
+	{
+		return ExecutionOrder<T>(order.GetProduct(), order.GetPricingSide(), order.GetOrderNumber(), order.GetOrderType(), order.GetPrice(), quantity, order.GetParentOrderNumber(), order.IsChildOrder());
+	}
+
+	// Publish a fill (or cancel) now, or after the latency
+	void SendFill(const Fill<T>& fill, bool cancel)
+	{
+		if (latency == 0)
+		{
+			Fill<T> f = fill;
+			Publish(f, cancel);
+			return;
+		}
+		int slot;
+		if (!freefills.empty())
+		{
+			slot = freefills.back();
+			freefills.pop_back();
+			pendingfills[slot] = make_pair(fill, cancel);
+		}
+		else
+		{
+			slot = (int)pendingfills.size();
+			pendingfills.push_back(make_pair(fill, cancel));
+		}
+		timers.Schedule(timers.GetTime() + latency, slot);
+	}
+
+	// Publish a fill whose latency has passed
+	void ReleaseFill(int slot)
+	{
+		pair<Fill<T>, bool> fill = pendingfills[slot];
+		freefills.push_back(slot);
+		Publish(fill.first, fill.second);
+	}
+
+	// Publish a fill, or notify the listeners of a cancelled remainder
+	void Publish(Fill<T>& fill, bool cancel)
+	{
+		if (!cancel)
+		{
+			OnMessage(fill);
+			return;
+		}
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessRemove(fill);
+		}
+	}
+};
+
+/*
+* Venue listener to the market data service
+*/
+template<typename T>
+class VenueMarketDataListener : public ServiceListener<OrderBook<T>>
+{
+private:
+	VenueService<T>* service;
+
+public:
+	//Ctor and Dtor
+	VenueMarketDataListener(VenueService<T>* s)
+	{
+		service = s;
+	}
+	~VenueMarketDataListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(OrderBook<T>& data)
+	{
+		service->UpdateBook(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(OrderBook<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(OrderBook<T>& data){}
+};
+
+/*
+* Venue listener to the execution service
+*/
+template<typename T>
+class VenueExecutionListener : public ServiceListener<ExecutionOrder<T>>
+{
+private:
+	VenueService<T>* service;
+
+public:
+	//Ctor and Dtor
+	VenueExecutionListener(VenueService<T>* s)
+	{
+		service = s;
+	}
+	~VenueExecutionListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(ExecutionOrder<T>& data)
+	{
+		service->SubmitOrder(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(ExecutionOrder<T>& data)
+	{
+		service->CancelOrder(data);
+	}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(ExecutionOrder<T>& data)
+	{
+		service->ReplaceOrder(data);
+	}
+};
+
+#endif
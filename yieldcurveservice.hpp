@@ -0,0 +1,377 @@
+/**
+ * yieldcurveservice.hpp
+ * Defines the data types and Service for the bootstrapped treasury curve.
+ *
+ * @author Tengxiao Fan
+ */
+#ifndef YIELD_CURVE_SERVICE_HPP
+#define YIELD_CURVE_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+
+/**
+ * Par yield of a semi-annual bond from its price (per 100 face).
+ * Solved with Newton's method on the closed form of the bond price.
+ */
+double ParYieldFromPrice(double price, double coupon, double tenor)
+{
+	double n = 2.0 * tenor;
+	double y = coupon > 0 ? coupon : 0.05;
+	for (int iter = 0; iter < 50; iter++)
+	{
+		double h = y / 2.0;
+		double v = pow(1.0 + h, -n);
+		double f, df;
+		if (fabs(h) < 1e-12)
+		{
+			f = 100.0 * (coupon / 2.0 * n + 1.0) - price;
+			df = -100.0 * (coupon / 2.0 * n * (n + 1) / 2.0 + n) / 2.0;
+		}
+		else
+		{
+			double annuity = (1.0 - v) / h;
+			double dannuity = (n * v / (1.0 + h) - annuity) / h;
+			double dv = -n * v / (1.0 + h);
+			f = 100.0 * (coupon / 2.0 * annuity + v) - price;
+			df = 100.0 * (coupon / 2.0 * dannuity + dv) / 2.0;
+		}
+		double step = f / df;
+		y -= step;
+		if (fabs(step) < 1e-12) break;
+	}
+	return y;
+}
+
+/**
+ * A discount curve bootstrapped from par yields at a set of pillar tenors.
+ * Discount factors are cached on a semi-annual grid.
+ */
+class YieldCurve
+{
+
+public:
+
+  // ctor for a curve
+	YieldCurve() {}
+	YieldCurve(string _name, const vector<double>& _pillars) :
+		name(_name), pillars(_pillars), paryields(_pillars.size(), 0.0), quoted(_pillars.size(), false)
+	{
+		size_t n = pillars.empty() ? 0 : (size_t)ceil(2.0 * pillars.back());
+		gridyields = vector<double>(n, 0.0);
+		discountfactors = vector<double>(n, 1.0);
+		annuities = vector<double>(n, 0.0);
+	}
+
+  // Get the name of the curve
+	const string& GetName() const
+	{
+		return name;
+	}
+
+  // Get the pillar tenors
+	const vector<double>& GetPillars() const
+	{
+		return pillars;
+	}
+
+  // Get the par yield of a pillar
+	double GetParYield(size_t i) const
+	{
+		return paryields[i];
+	}
+
+  // Get the index of a pillar given its tenor (-1 if none)
+	int GetPillarIndex(double tenor) const
+	{
+		for (size_t i = 0; i < pillars.size(); i++)
+		{
+			if (fabs(pillars[i] - tenor) < 1e-9) return (int)i;
+		}
+		return -1;
+	}
+
+  // Set the par yield of a pillar, returns true if it is the first quote of the pillar
+	bool SetParYield(size_t i, double y)
+	{
+		bool first = !quoted[i];
+		paryields[i] = y;
+		quoted[i] = true;
+		return first;
+	}
+
+  // Bootstrap the whole curve, returns the number of grid points bootstrapped
+	size_t Bootstrap()
+	{
+		InterpolateParYields(0, gridyields.size());
+		return BootstrapFrom(0);
+	}
+
+  // Bootstrap after a change of pillar i: par yields are re-interpolated between its
+  // quoted neighbours only, and discount factors are rebuilt from the first affected point
+	size_t Bootstrap(size_t i)
+	{
+		int prev = -1;
+		int next = -1;
+		for (int k = (int)i - 1; k >= 0; k--)
+		{
+			if (quoted[k])
+			{
+				prev = k;
+				break;
+			}
+		}
+		for (size_t k = i + 1; k < pillars.size(); k++)
+		{
+			if (quoted[k])
+			{
+				next = (int)k;
+				break;
+			}
+		}
+		size_t begin = prev < 0 ? 0 : (size_t)floor(2.0 * pillars[prev] + 1e-9);
+		size_t end = next < 0 ? gridyields.size() : (size_t)ceil(2.0 * pillars[next] - 1e-9) - 1;
+		InterpolateParYields(begin, end);
+		return BootstrapFrom(begin);
+	}
+
+  // Get the discount factor at time t (log-linear between grid points)
+	double GetDiscountFactor(double t) const
+	{
+		if (t <= 0 || discountfactors.empty()) return 1.0;
+		double x = 2.0 * t;
+		size_t n = discountfactors.size();
+		if (x >= n)
+		{
+			//Flat extrapolation of the last zero rate
+			double r = -log(discountfactors[n - 1]) / (n / 2.0);
+			return exp(-r * t);
+		}
+		size_t i = (size_t)floor(x);
+		double lower = i == 0 ? 1.0 : discountfactors[i - 1];
+		double upper = discountfactors[i];
+		double w = x - i;
+		return exp((1.0 - w) * log(lower) + w * log(upper));
+	}
+
+  // Get the continuously compounded zero rate at time t
+	double GetZeroRate(double t) const
+	{
+		if (t <= 0) return 0.0;
+		return -log(GetDiscountFactor(t)) / t;
+	}
+
+  // Get the instantaneous forward rate at time t (constant between grid points, as discount factors are log-linear)
+	double GetInstantaneousForwardRate(double t) const
+	{
+		size_t n = discountfactors.size();
+		if (n == 0) return 0.0;
+		double x = max(0.0, 2.0 * t);
+		if (x >= n) return -log(discountfactors[n - 1]) / (n / 2.0);
+		size_t i = (size_t)floor(x);
+		double lower = i == 0 ? 1.0 : discountfactors[i - 1];
+		return 2.0 * log(lower / discountfactors[i]);
+	}
+
+  // Get the continuously compounded forward rate between t1 and t2, the instantaneous one if they are equal
+	double GetForwardRate(double t1, double t2) const
+	{
+		if (t1 == t2) return GetInstantaneousForwardRate(t1);
+		return log(GetDiscountFactor(t1) / GetDiscountFactor(t2)) / (t2 - t1);
+	}
+
+private:
+  string name;
+  vector<double> pillars;
+  vector<double> paryields;
+  vector<bool> quoted;
+  vector<double> gridyields;
+  vector<double> discountfactors;
+  vector<double> annuities;
+
+  // Linear interpolation of the quoted par yields onto grid points [begin, end)
+	void InterpolateParYields(size_t begin, size_t end)
+	{
+		for (size_t g = begin; g < end; g++)
+		{
+			double t = (g + 1) / 2.0;
+			int lower = -1;
+			int upper = -1;
+			for (size_t k = 0; k < pillars.size(); k++)
+			{
+				if (!quoted[k]) continue;
+				if (pillars[k] <= t) lower = (int)k;
+				if (pillars[k] >= t)
+				{
+					upper = (int)k;
+					break;
+				}
+			}
+			double y = 0.0;
+			if (lower < 0 && upper < 0) y = 0.0;
+			else if (lower < 0) y = paryields[upper];
+			else if (upper < 0 || upper == lower) y = paryields[lower];
+			else
+			{
+				double w = (t - pillars[lower]) / (pillars[upper] - pillars[lower]);
+				y = (1.0 - w) * paryields[lower] + w * paryields[upper];
+			}
+			gridyields[g] = y;
+		}
+	}
+
+  // Par bootstrap of the semi-annual discount factors from grid point begin onwards
+	size_t BootstrapFrom(size_t begin)
+	{
+		double annuity = begin == 0 ? 0.0 : annuities[begin - 1];
+		for (size_t g = begin; g < gridyields.size(); g++)
+		{
+			double c = gridyields[g] / 2.0;
+			discountfactors[g] = (1.0 - c * annuity) / (1.0 + c);
+			annuity += discountfactors[g];
+			annuities[g] = annuity;
+		}
+		return gridyields.size() - begin;
+	}
+
+};
+
+/*
+* Pre declaration of the listener to pricing
+*/
+template<typename T>
+class YieldCurvePricingListener;
+
+/**
+ * Yield Curve Service bootstrapping a discount curve from the on-the-run mids.
+ * Keyed on curve name.
+ * Type T is the product type.
+ */
+template<typename T>
+class YieldCurveService : public Service<string, YieldCurve>
+{
+private:
+	map<string, YieldCurve> curvemap;
+	vector<ServiceListener<YieldCurve>*> listeners;
+	YieldCurvePricingListener<T>* PricingListener;
+	string curvename;
+	bool incremental;
+
+public:
+	//Ctor and Dtor
+	YieldCurveService()
+	{
+		curvemap = map<string, YieldCurve>();
+		listeners = vector<ServiceListener<YieldCurve>*>();
+		PricingListener = new YieldCurvePricingListener<T>(this);
+		curvename = "UST";
+		incremental = true;
+		curvemap[curvename] = YieldCurve(curvename, vector<double>{ 2, 3, 5, 7, 10, 20, 30 });
+	}
+	~YieldCurveService() = default;
+
+	// Get data on our service given a key
+	YieldCurve& GetData(string key)
+	{
+		return curvemap[key];
+	}
+
+	// The callback that a Connector should invoke for any new or updated data
+	void OnMessage(YieldCurve& data)
+	{
+		string key = data.GetName();
+		curvemap[key] = data;
+		Notify(curvemap[key]);
+	}
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	void AddListener(ServiceListener<YieldCurve>* listener)
+	{
+		listeners.push_back(listener);
+	}
+
+	// Get all listeners on the Service
+	const vector<ServiceListener<YieldCurve>*>& GetListeners() const
+	{
+		return listeners;
+	}
+
+	// Get the listener to the pricing service
+	YieldCurvePricingListener<T>* GetPricingListener()
+	{
+		return PricingListener;
+	}
+
+	// Get the treasury curve
+	YieldCurve& GetCurve()
+	{
+		return curvemap[curvename];
+	}
+
+	// Choose between incremental and full re-bootstrap on each tick
+	void SetIncremental(bool b)
+	{
+		incremental = b;
+	}
+
+	// Update the curve from a new mid of an on-the-run bond
+	void UpdatePrice(Price<T>& price)
+	{
+		const T& product = price.GetProduct();
+		YieldCurve& curve = curvemap[curvename];
+		int pillar = curve.GetPillarIndex(GetTenor(product.GetProductId()));
+		if (pillar < 0) return;
+		double y = ParYieldFromPrice(price.GetMid(), product.GetCoupon(), curve.GetPillars()[pillar]);
+		if (fabs(y - curve.GetParYield(pillar)) < 1e-14) return;
+		//A new pillar changes the interpolation everywhere, so it needs a full rebuild
+		bool first = curve.SetParYield(pillar, y);
+		if (incremental && !first) curve.Bootstrap(pillar);
+		else curve.Bootstrap();
+		Notify(curve);
+	}
+
+private:
+	// Notify all the listeners
+	void Notify(YieldCurve& curve)
+	{
+		for (auto i = listeners.begin(); i != listeners.end(); i++)
+		{
+			(*i)->ProcessAdd(curve);
+		}
+	}
+};
+
+/*
+* Yield curve listener to the pricing service
+*/
+template<typename T>
+class YieldCurvePricingListener : public ServiceListener<Price<T>>
+{
+private:
+	YieldCurveService<T>* service;
+
+public:
+	//Ctor and Dtor
+	YieldCurvePricingListener(YieldCurveService<T>* s)
+	{
+		service = s;
+	}
+	~YieldCurvePricingListener() = default;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Price<T>& data)
+	{
+		service->UpdatePrice(data);
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Price<T>& data){}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Price<T>& data){}
+};
+
+#endif